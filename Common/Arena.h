@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump-pointer arena：按块向系统要内存，分配只是移动指针，析构时整块释放
+// 不会调用对象的析构函数，所以只能放平凡析构的类型
+class Arena {
+private:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    size_t blockSize; // 每次至少要这么多
+    std::vector<char*> blocks;
+    char* cur;
+    char* end;
+    size_t used;     // 已分配给对象的字节数
+    size_t reserved; // 向系统要的字节数
+
+    // Function to get a fresh block of at least size bytes and make it current
+    void grow(size_t size)
+    {
+        size_t bytes = size > blockSize ? size : blockSize;
+        char* block = static_cast<char*>(std::malloc(bytes));
+        if(block == nullptr)
+            throw std::bad_alloc();
+        blocks.push_back(block);
+        reserved += bytes;
+        cur = block;
+        end = block + bytes;
+    }
+
+public:
+    // 事先知道总共要多少字节时（例如一个函数的中间表示）可以给出 minBlockSize，一块就够，不多占内存
+    explicit Arena(size_t minBlockSize = DEFAULT_BLOCK_SIZE)
+        : blockSize(minBlockSize)
+        , cur(nullptr)
+        , end(nullptr)
+        , used(0)
+        , reserved(0)
+    {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena()
+    {
+        release();
+    }
+
+    // Function to get size bytes aligned to align, valid until the arena is released
+    void* allocate(size_t size, size_t align)
+    {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~uintptr_t(align - 1);
+        if(cur == nullptr || p + size > reinterpret_cast<uintptr_t>(end))
+        {
+            grow(size + align);
+            p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~uintptr_t(align - 1);
+        }
+        cur = reinterpret_cast<char*>(p + size);
+        used += size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    template<class T, class... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Function to copy n elements into the arena
+    template<class T>
+    T* copyArray(const T* items, size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "arena arrays are copied bytewise");
+        if(n == 0)
+            return nullptr;
+        T* out = static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+        std::copy(items, items + n, out);
+        return out;
+    }
+
+    // Function to free every block at once
+    void release()
+    {
+        for(char* block : blocks)
+            std::free(block);
+        blocks.clear();
+        cur = end = nullptr;
+        used = reserved = 0;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+// 字符分类表：每个字节对应一组标志位，词法分析的热循环里一次查表 + 一次按位与即可分类
+enum CharClassFlag : uint8_t {
+    CHAR_WHITESPACE     = 1 << 0, // ' ' '\t' '\n' '\r'
+    CHAR_NEWLINE        = 1 << 1, // '\n'
+    CHAR_IDENT_START    = 1 << 2, // 字母和下划线
+    CHAR_IDENT_CONTINUE = 1 << 3, // 字母、数字和下划线
+    CHAR_DIGIT          = 1 << 4,
+    CHAR_OPERATOR       = 1 << 5, // + - * / % = < > ! & |
+    CHAR_PUNCTUATOR     = 1 << 6, // ( ) { } ; ,
+};
+
+struct CharClassTable {
+    uint8_t flags[256];
+};
+
+constexpr CharClassTable buildCharClassTable()
+{
+    CharClassTable table{};
+    for(int c = 0; c < 256; c++)
+    {
+        uint8_t f = 0;
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        bool digit = c >= '0' && c <= '9';
+        if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            f |= CHAR_WHITESPACE;
+        if(c == '\n')
+            f |= CHAR_NEWLINE;
+        if(alpha || c == '_')
+            f |= CHAR_IDENT_START | CHAR_IDENT_CONTINUE;
+        if(digit)
+            f |= CHAR_DIGIT | CHAR_IDENT_CONTINUE;
+        if(c == '+' || c == '-' || c == '*' || c == '/' || c == '%'
+           || c == '=' || c == '<' || c == '>' || c == '!'
+           || c == '&' || c == '|')
+            f |= CHAR_OPERATOR;
+        if(c == '(' || c == ')' || c == '{' || c == '}'
+           || c == ';' || c == ',')
+            f |= CHAR_PUNCTUATOR;
+        table.flags[c] = f;
+    }
+    return table;
+}
+
+inline constexpr CharClassTable charClassTable = buildCharClassTable();
+
+// Function to get the class flags of a character
+inline uint8_t charClassOf(char c)
+{
+    return charClassTable.flags[uint8_t(c)];
+}
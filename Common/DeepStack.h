@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <type_traits>
+
+// 深层递归的栈扩展：递归下降每深入固定层数，就把后续的递归放到一个新线程上执行，
+// 新线程有自己的一段大栈，当前线程只是等它结束。
+// 这样代码仍然是普通的递归，诊断信息和顺序不变；浅的输入永远不会触发切换。
+// 线程栈由 pthread 用 mmap 保留，只有真正用到的页才占用内存。
+
+const size_t DEEP_STACK_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+template<class F>
+void* deepStackEntry(void* arg)
+{
+    (*static_cast<F*>(arg))();
+    return nullptr;
+}
+
+// Function to run f on a fresh stack of the given size and wait for it to finish
+template<class F>
+void runOnFreshStack(F&& f, size_t stackSize = DEEP_STACK_SEGMENT_SIZE)
+{
+    typedef typename std::remove_reference<F>::type Fn;
+    pthread_attr_t attr;
+    pthread_t thread;
+    bool started = false;
+    if(pthread_attr_init(&attr) == 0) // 初始化失败的 attr 不能再 destroy
+    {
+        started = pthread_attr_setstacksize(&attr, stackSize) == 0
+                  && pthread_create(&thread, &attr, deepStackEntry<Fn>, &f) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    if(!started)
+    {
+        // 建不了线程时没有别的栈可用，与其悄悄溢出不如明确地退出
+        std::fprintf(stderr, "cannot create a thread for deep recursion\n");
+        std::abort();
+    }
+    pthread_join(thread, nullptr);
+}
+
+// Class that counts recursion depth and moves to a fresh stack every levelsPerSegment levels
+class DeepStack {
+private:
+    unsigned untilSwitch; // 再深入多少层就换栈
+    unsigned segmentDepth;
+
+public:
+    explicit DeepStack(unsigned levelsPerSegment = 2000)
+        : untilSwitch(levelsPerSegment)
+        , segmentDepth(levelsPerSegment)
+    {}
+
+    // Function to run f one level deeper, on a fresh stack when the current one has had its share
+    template<class F>
+    auto recurse(F&& f) -> decltype(f())
+    {
+        if(--untilSwitch != 0)
+        {
+            auto result = f();
+            untilSwitch++;
+            return result;
+        }
+        untilSwitch = segmentDepth;
+        decltype(f()) result{};
+        runOnFreshStack([&] { result = f(); });
+        untilSwitch = 1; // 回到原来的栈段，这一层用掉的额度还回去
+        return result;
+    }
+};
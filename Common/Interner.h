@@ -0,0 +1,259 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "Arena.h"
+
+// 标识符驻留：每个不同的名字只存一份，对应一个从 0 开始连续编号的 32 位符号 ID，
+// 之后的比较、查重和符号表都只用整数。名字的字符放在只追加的 Arena 里，
+// 哈希表是开放寻址（线性探测），槽里只有哈希值和 ID，探测时先比哈希再比字符。
+
+// Function to hash an identifier, eight bytes at a time
+inline uint32_t hashIdentifier(std::string_view name)
+{
+    const char* p = name.data();
+    size_t n = name.size();
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    for(; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    if(n > 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, p, n);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+    }
+    h ^= h >> 29;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return uint32_t(h ^ (h >> 32));
+}
+
+// Struct to represent how much interning saved
+struct InternerStats {
+    size_t occurrences; // intern() 的调用次数，即标识符出现的次数
+    size_t unique;      // 不同名字的个数
+    size_t nameBytes;   // 名字本身占用的字节数
+    size_t tableBytes;  // 哈希表和 ID -> 名字表占用的字节数
+};
+
+// Class that implements the open-addressing table shared by both interners
+// 只负责“哈希 + 名字 -> ID”的查找和插入，名字存在哪里由使用者决定
+class InternTable {
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t id; // EMPTY 表示空槽
+    };
+
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<Slot> slots;
+    size_t count;
+
+    void grow()
+    {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, EMPTY});
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for(const Slot& slot : old)
+        {
+            if(slot.id == EMPTY)
+                continue;
+            size_t i = slot.hash & mask;
+            while(slots[i].id != EMPTY)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+public:
+    InternTable()
+        : slots(1024, Slot{0, EMPTY})
+        , count(0)
+    {}
+
+    // Function to find the ID stored for a name, nameOf(id) gives the text of a stored ID
+    // 没找到时返回 UINT32_MAX，并把 insertAt 设为可以插入的空槽
+    template<class NameOf>
+    uint32_t find(std::string_view name, uint32_t hash, NameOf&& nameOf, size_t& insertAt) const
+    {
+        size_t mask = slots.size() - 1;
+        for(size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots[i];
+            if(slot.id == EMPTY)
+            {
+                insertAt = i;
+                return UINT32_MAX;
+            }
+            if(slot.hash == hash && nameOf(slot.id) == name)
+                return slot.id;
+        }
+    }
+
+    // Function to fill the empty slot returned by find(), keeps the load factor at most one half
+    void insert(size_t at, uint32_t hash, uint32_t id)
+    {
+        slots[at] = Slot{hash, id};
+        if(++count * 2 > slots.size())
+            grow();
+    }
+
+    size_t bytesUsed() const { return slots.size() * sizeof(Slot); }
+};
+
+// Class that maps identifiers to dense 32-bit symbol IDs, single-threaded
+class Interner {
+private:
+    InternTable table;
+    std::vector<std::string_view> names; // ID -> 名字，字符在 chars 里
+    Arena chars;
+    size_t occurrences;
+
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    Interner()
+        : occurrences(0)
+    {}
+
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    // Function to get the ID of a name, adding it the first time it is seen
+    uint32_t intern(std::string_view name)
+    {
+        occurrences++;
+        uint32_t hash = hashIdentifier(name);
+        size_t at = 0;
+        uint32_t id = table.find(name, hash, [this](uint32_t i) { return names[i]; }, at);
+        if(id != NONE)
+            return id;
+        id = uint32_t(names.size());
+        names.push_back(std::string_view(chars.copyArray(name.data(), name.size()), name.size()));
+        table.insert(at, hash, id);
+        return id;
+    }
+
+    // Function to get the ID of a name without adding it, NONE if it was never interned
+    uint32_t find(std::string_view name) const
+    {
+        size_t at = 0;
+        return table.find(name, hashIdentifier(name), [this](uint32_t i) { return names[i]; }, at);
+    }
+
+    std::string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    InternerStats stats() const
+    {
+        return InternerStats{occurrences, names.size(), chars.bytesUsed(),
+                             table.bytesUsed() + names.capacity() * sizeof(std::string_view)};
+    }
+};
+
+// Class that maps identifiers to dense 32-bit symbol IDs and may be shared between threads
+// 按哈希的高位分成若干分片，每个分片有自己的锁、哈希表和字符 Arena，不同分片的名字互不等待；
+// ID 由一个原子计数器统一分配，所以仍然是从 0 开始连续的，只是编号顺序取决于线程的先后。
+// ID -> 名字的表按段分配，段一旦建立就不再移动，name() 不加锁；
+// 调用 name(id) 的线程必须是通过 intern() 或其他同步手段拿到这个 id 的
+class ConcurrentInterner {
+private:
+    static const unsigned SHARD_BITS = 6;
+    static const unsigned SHARD_COUNT = 1u << SHARD_BITS;
+    static const unsigned SEGMENT_BITS = 16;
+    static const size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+    static const size_t SEGMENT_COUNT = size_t(1) << (32 - SEGMENT_BITS);
+
+    struct Shard {
+        std::mutex lock;
+        InternTable table;
+        Arena chars;
+        size_t occurrences = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    std::unique_ptr<std::atomic<std::string_view*>[]> segments;
+    std::atomic<uint32_t> nextId;
+
+    // Function to get the slot of an ID in the segmented name table, creating its segment if needed
+    std::string_view& nameSlot(uint32_t id)
+    {
+        std::atomic<std::string_view*>& segment = segments[id >> SEGMENT_BITS];
+        std::string_view* names = segment.load(std::memory_order_acquire);
+        if(names == nullptr)
+        {
+            std::string_view* fresh = new std::string_view[SEGMENT_SIZE];
+            if(segment.compare_exchange_strong(names, fresh, std::memory_order_acq_rel))
+                names = fresh;
+            else
+                delete[] fresh; // 别的线程先建好了，names 已经是它建的那一段
+        }
+        return names[id & (SEGMENT_SIZE - 1)];
+    }
+
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    ConcurrentInterner()
+        : shards(new Shard[SHARD_COUNT])
+        , segments(new std::atomic<std::string_view*>[SEGMENT_COUNT])
+        , nextId(0)
+    {
+        for(size_t i = 0; i < SEGMENT_COUNT; i++)
+            segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ConcurrentInterner(const ConcurrentInterner&) = delete;
+    ConcurrentInterner& operator=(const ConcurrentInterner&) = delete;
+
+    ~ConcurrentInterner()
+    {
+        for(size_t i = 0; i < SEGMENT_COUNT; i++)
+            delete[] segments[i].load(std::memory_order_relaxed);
+    }
+
+    // Function to get the ID of a name, adding it the first time any thread sees it
+    uint32_t intern(std::string_view name)
+    {
+        uint32_t hash = hashIdentifier(name);
+        Shard& shard = shards[hash >> (32 - SHARD_BITS)];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.occurrences++;
+        size_t at = 0;
+        uint32_t id = shard.table.find(name, hash, [this](uint32_t i) { return nameSlot(i); }, at);
+        if(id != NONE)
+            return id;
+        id = nextId.fetch_add(1, std::memory_order_relaxed);
+        nameSlot(id) = std::string_view(shard.chars.copyArray(name.data(), name.size()), name.size());
+        shard.table.insert(at, hash, id);
+        return id;
+    }
+
+    std::string_view name(uint32_t id) { return nameSlot(id); }
+    size_t size() const { return nextId.load(std::memory_order_relaxed); }
+
+    // Function to sum the statistics of every shard, only meaningful while no thread is interning
+    InternerStats stats()
+    {
+        InternerStats total{0, size(), 0, 0};
+        for(unsigned i = 0; i < SHARD_COUNT; i++)
+        {
+            total.occurrences += shards[i].occurrences;
+            total.nameBytes += shards[i].chars.bytesUsed();
+            total.tableBytes += shards[i].table.bytesUsed();
+        }
+        size_t segmentsUsed = (total.unique + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        total.tableBytes += segmentsUsed * SEGMENT_SIZE * sizeof(std::string_view);
+        return total;
+    }
+};
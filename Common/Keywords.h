@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+#include "TokenKind.h"
+
+// 关键字识别：长度 + 首字符的完美哈希，表在编译期生成，不需要任何运行时初始化
+// int if else while break continue return void 只有 8 个，16 个槽位足够且无冲突
+
+struct KeywordSlot {
+    const char* spelling;
+    uint8_t length;
+    TokenKind kind;
+};
+
+constexpr KeywordSlot keywordList[] = {
+    {"int",      3, TokenKind::KW_INT},
+    {"if",       2, TokenKind::KW_IF},
+    {"else",     4, TokenKind::KW_ELSE},
+    {"while",    5, TokenKind::KW_WHILE},
+    {"break",    5, TokenKind::KW_BREAK},
+    {"continue", 8, TokenKind::KW_CONTINUE},
+    {"return",   6, TokenKind::KW_RETURN},
+    {"void",     4, TokenKind::KW_VOID},
+};
+
+constexpr size_t KEYWORD_MIN_LENGTH = 2;
+constexpr size_t KEYWORD_MAX_LENGTH = 8;
+constexpr unsigned KEYWORD_TABLE_SIZE = 16;
+
+// Function to hash a candidate word by its first character and length
+constexpr unsigned keywordHash(char first, size_t length)
+{
+    return (unsigned(uint8_t(first)) * 3 + unsigned(length)) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+struct KeywordTable {
+    KeywordSlot slots[KEYWORD_TABLE_SIZE];
+};
+
+constexpr KeywordTable buildKeywordTable()
+{
+    KeywordTable table{};
+    for(const KeywordSlot& kw : keywordList)
+        table.slots[keywordHash(kw.spelling[0], kw.length)] = kw;
+    return table;
+}
+
+// Function to check at compile time that no two keywords share a slot
+constexpr bool keywordHashIsPerfect()
+{
+    for(const KeywordSlot& a : keywordList)
+        for(const KeywordSlot& b : keywordList)
+            if(a.kind != b.kind
+               && keywordHash(a.spelling[0], a.length) == keywordHash(b.spelling[0], b.length))
+                return false;
+    return true;
+}
+
+static_assert(keywordHashIsPerfect(), "keyword hash has a collision, pick another multiplier");
+
+inline constexpr KeywordTable keywordTable = buildKeywordTable();
+
+// Function to get the keyword kind of a word, or TokenKind::IDENTIFIER if it is not a keyword
+inline TokenKind lookupKeyword(std::string_view word)
+{
+    size_t length = word.size();
+    if(length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
+        return TokenKind::IDENTIFIER;
+    const KeywordSlot& slot = keywordTable.slots[keywordHash(word[0], length)];
+    if(slot.length != length || std::memcmp(slot.spelling, word.data(), length) != 0)
+        return TokenKind::IDENTIFIER;
+    return slot.kind;
+}
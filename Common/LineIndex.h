@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "Scan.h"
+
+// 换行位置索引：token 只记录字节偏移，行号和列号在真正需要时（报错）才由偏移二分查出
+// 索引在第一次查询时一次性建立，合法输入的分析过程完全不碰它；
+// 建立过程由 call_once 保护，多个线程可以共用同一个索引
+class LineIndex {
+private:
+    std::string_view source;
+    std::vector<uint32_t> newlines; // 每个 '\n' 的偏移，递增
+    std::once_flag built;
+
+    // Function to collect the offsets of every '\n' in the source
+    void build()
+    {
+        const char* begin = source.data();
+        const char* end = begin + source.size();
+        const char* p = begin;
+        newlines.reserve(source.size() / 32 + 1);
+#if SCAN_HAVE_X86
+        const __m128i newline = _mm_set1_epi8('\n');
+        for(; end - p >= 16; p += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+            while(mask != 0)
+            {
+                newlines.push_back(uint32_t(p - begin) + unsigned(__builtin_ctz(mask)));
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for(; p < end; p++)
+        {
+            if(*p == '\n')
+                newlines.push_back(uint32_t(p - begin));
+        }
+    }
+
+    // Function to get the number of '\n' strictly before offset
+    size_t newlinesBefore(uint32_t offset)
+    {
+        std::call_once(built, [this] { build(); });
+        return size_t(std::lower_bound(newlines.begin(), newlines.end(), offset) - newlines.begin());
+    }
+
+public:
+    // source 必须比索引活得久
+    explicit LineIndex(std::string_view text)
+        : source(text)
+    {}
+
+    // Function to get the 1-based line of a byte offset
+    int lineOf(uint32_t offset)
+    {
+        return int(newlinesBefore(offset)) + 1;
+    }
+
+    // Function to get the 1-based column of a byte offset
+    int columnOf(uint32_t offset)
+    {
+        size_t before = newlinesBefore(offset);
+        uint32_t lineStart = before == 0 ? 0 : newlines[before - 1] + 1;
+        return int(offset - lineStart) + 1;
+    }
+};
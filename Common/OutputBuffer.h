@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+// 大块缓冲的输出：格式化直接写进一块复用的缓冲区，满了才一次 write() 出去，
+// 整数转文本不经过 iostream，也不会像 endl 那样每行刷新一次
+class OutputBuffer {
+private:
+    static const size_t DEFAULT_CAPACITY = 1 << 20;
+
+    int fd;
+    std::vector<char> buffer;
+    size_t used;
+    bool failed; // 某次 write() 出错后不再尝试，由 flush() 的返回值告诉调用者
+
+    // Function to make sure at least n more bytes fit, flushing first if they do not
+    void reserve(size_t n)
+    {
+        if(used + n > buffer.size())
+        {
+            flush();
+            if(n > buffer.size())
+                buffer.resize(n);
+        }
+    }
+
+public:
+    explicit OutputBuffer(int outputFd, size_t capacity = DEFAULT_CAPACITY)
+        : fd(outputFd)
+        , buffer(capacity)
+        , used(0)
+        , failed(false)
+    {}
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer()
+    {
+        flush();
+    }
+
+    void append(std::string_view text)
+    {
+        reserve(text.size());
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void append(char c)
+    {
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    // Function to append the decimal digits of value
+    void appendUnsigned(uint64_t value)
+    {
+        char digits[20];
+        char* p = digits + sizeof(digits);
+        do
+        {
+            *--p = char('0' + value % 10);
+            value /= 10;
+        } while(value != 0);
+        append(std::string_view(p, size_t(digits + sizeof(digits) - p)));
+    }
+
+    // Function to write out everything buffered so far, false if any write failed
+    // 只有在内核写了一部分时才会继续补写剩下的字节
+    bool flush()
+    {
+        const char* p = buffer.data();
+        size_t left = used;
+        while(left > 0 && !failed)
+        {
+            ssize_t n = ::write(fd, p, left);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                failed = true;
+                break;
+            }
+            p += n;
+            left -= size_t(n);
+        }
+        used = 0;
+        return !failed;
+    }
+};
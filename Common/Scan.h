@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include "CharClass.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_HAVE_X86 0
+#endif
+
+// 词法分析中的长距离扫描：注释、空白、标识符
+// 查找注释结尾这类可能很长的扫描在运行时按 CPU 选择 AVX2 / SSE2 实现；
+// 空白和标识符通常很短，直接用 x86-64 必有的 SSE2，其他平台退回查表的标量实现。
+// 所有函数都只在 [p, end) 内读取，不会越界。
+
+// Function to find the first target byte in [p, end), counting '\n' skipped on the way
+inline const char* scanFindByteScalar(const char* p, const char* end, char target, size_t* newlines)
+{
+    size_t count = 0;
+    while(p < end && *p != target)
+    {
+        count += (*p == '\n');
+        p++;
+    }
+    if(newlines != nullptr)
+        *newlines += count;
+    return p;
+}
+
+#if SCAN_HAVE_X86
+
+inline const char* scanFindByteSSE2(const char* p, const char* end, char target, size_t* newlines)
+{
+    const __m128i wanted = _mm_set1_epi8(target);
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    while(end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned hit = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, wanted)));
+        unsigned lines = newlines != nullptr ? unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline))) : 0;
+        if(hit != 0)
+        {
+            unsigned idx = unsigned(__builtin_ctz(hit));
+            count += unsigned(__builtin_popcount(lines & ((1u << idx) - 1)));
+            if(newlines != nullptr)
+                *newlines += count;
+            return p + idx;
+        }
+        count += unsigned(__builtin_popcount(lines));
+        p += 16;
+    }
+    if(newlines != nullptr)
+        *newlines += count;
+    return scanFindByteScalar(p, end, target, newlines);
+}
+
+__attribute__((target("avx2")))
+inline const char* scanFindByteAVX2(const char* p, const char* end, char target, size_t* newlines)
+{
+    const __m256i wanted = _mm256_set1_epi8(target);
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    while(end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned hit = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, wanted)));
+        unsigned lines = newlines != nullptr ? unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline))) : 0;
+        if(hit != 0)
+        {
+            unsigned idx = unsigned(__builtin_ctz(hit));
+            count += unsigned(__builtin_popcount(lines & ((1ull << idx) - 1)));
+            if(newlines != nullptr)
+                *newlines += count;
+            return p + idx;
+        }
+        count += unsigned(__builtin_popcount(lines));
+        p += 32;
+    }
+    if(newlines != nullptr)
+        *newlines += count;
+    return scanFindByteSSE2(p, end, target, newlines);
+}
+
+#endif
+
+typedef const char* (*ScanFindByteFn)(const char*, const char*, char, size_t*);
+
+inline ScanFindByteFn selectScanFindByte()
+{
+#if SCAN_HAVE_X86
+    if(__builtin_cpu_supports("avx2"))
+        return scanFindByteAVX2;
+    return scanFindByteSSE2;
+#else
+    return scanFindByteScalar;
+#endif
+}
+
+// Function to find the first target byte in [p, end), or end if there is none
+// newlines 非空时累加跳过的 '\n' 个数（不含目标字节本身）
+inline const char* scanFindByte(const char* p, const char* end, char target, size_t* newlines = nullptr)
+{
+    static const ScanFindByteFn impl = selectScanFindByte();
+    return impl(p, end, target, newlines);
+}
+
+// Function to skip identifier characters [A-Za-z0-9_], returns the first other byte
+inline const char* scanIdentifierEnd(const char* p, const char* end)
+{
+    // 短标识符直接标量判断，长的再交给 SIMD
+    for(int i = 0; i < 8; i++, p++)
+    {
+        if(p == end || !(charClassOf(*p) & CHAR_IDENT_CONTINUE))
+            return p;
+    }
+#if SCAN_HAVE_X86
+    while(end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20)); // 大小写折叠，只对字母区间有意义
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        unsigned ident = unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under)));
+        if(ident != 0xFFFF)
+            return p + __builtin_ctz(~ident);
+        p += 16;
+    }
+#endif
+    while(p < end && (charClassOf(*p) & CHAR_IDENT_CONTINUE))
+        p++;
+    return p;
+}
+
+// Function to skip whitespace, returns the first other byte
+inline const char* scanWhitespaceEnd(const char* p, const char* end)
+{
+    // 大多数空白只有一两个字节（单个空格、换行），先用标量看几个，长的缩进再交给 SIMD
+    for(int i = 0; i < 4; i++, p++)
+    {
+        if(p == end || !(charClassOf(*p) & CHAR_WHITESPACE))
+            return p;
+    }
+#if SCAN_HAVE_X86
+    while(end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                               _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                               _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        unsigned blank = unsigned(_mm_movemask_epi8(ws));
+        if(blank != 0xFFFF)
+            return p + __builtin_ctz(~blank);
+        p += 16;
+    }
+#endif
+    while(p < end && (charClassOf(*p) & CHAR_WHITESPACE))
+        p++;
+    return p;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// 按作用域嵌套的符号表，键是 Interner 给出的符号 ID。
+// ID 从 0 开始连续编号，所以“哈希表”就是一个按 ID 下标的数组，查找是一次下标访问；
+// 数组里放的是每个名字当前最内层的绑定。声明时把被遮住的旧绑定记进撤销日志，
+// 离开作用域时按日志倒序恢复，花费只与这个作用域里的声明个数有关，不复制任何表。
+class ScopedSymbolTable {
+private:
+    struct Binding {
+        uint32_t scope; // 声明所在作用域的深度，NONE 表示没有绑定
+        uint32_t value;
+    };
+
+    struct Undo {
+        uint32_t id;
+        Binding previous;
+    };
+
+    std::vector<Binding> bindings; // 按符号 ID 下标
+    std::vector<Undo> undoLog;
+    std::vector<size_t> scopeStarts; // 每个打开的作用域开始时撤销日志的长度
+
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // Function to open a nested scope
+    void enterScope()
+    {
+        scopeStarts.push_back(undoLog.size());
+    }
+
+    // Function to close the innermost scope, dropping everything declared in it
+    void exitScope()
+    {
+        size_t start = scopeStarts.back();
+        scopeStarts.pop_back();
+        while(undoLog.size() > start)
+        {
+            const Undo& undo = undoLog.back();
+            bindings[undo.id] = undo.previous;
+            undoLog.pop_back();
+        }
+    }
+
+    // Function to bind id to value in the innermost scope, false if id is already declared there
+    bool declare(uint32_t id, uint32_t value)
+    {
+        if(id >= bindings.size())
+            bindings.resize(size_t(id) + 1, Binding{NONE, 0});
+        uint32_t scope = uint32_t(scopeStarts.size());
+        Binding& binding = bindings[id];
+        if(binding.scope == scope)
+            return false;
+        undoLog.push_back(Undo{id, binding});
+        binding = Binding{scope, value};
+        return true;
+    }
+
+    // Function to get the value of the innermost visible declaration of id, NONE if there is none
+    uint32_t lookup(uint32_t id) const
+    {
+        if(id >= bindings.size() || bindings[id].scope == NONE)
+            return NONE;
+        return bindings[id].value;
+    }
+
+    size_t depth() const { return scopeStarts.size(); }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Class that holds the source text of one input
+// 普通文件直接只读 mmap，词法分析在映射上进行；管道/终端输入一次性 read 进一个缓冲区
+class SourceBuffer {
+private:
+    void* mapped;        // mmap 得到的地址，没有映射时为 nullptr
+    size_t mappedSize;
+    std::string owned;   // 非映射输入（或补了换行的副本）的存放位置
+    std::string_view text;
+
+    void unmap()
+    {
+        if(mapped != nullptr)
+        {
+            munmap(mapped, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+    }
+
+    // Function to map a regular file, returns false if the caller should fall back to read()
+    bool mapFile(int fd, size_t size)
+    {
+        if(lseek(fd, 0, SEEK_CUR) != 0) // 已经被读过一部分的描述符不能从头映射
+            return false;
+
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE; // 预先建立页表，避免逐页缺页
+#endif
+        void* addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if(addr == MAP_FAILED)
+            return false;
+        madvise(addr, size, MADV_SEQUENTIAL);
+
+        mapped = addr;
+        mappedSize = size;
+        text = std::string_view(static_cast<const char*>(addr), size);
+        return true;
+    }
+
+    // Function to read everything left on fd straight into the owned buffer
+    bool readAll(int fd, size_t sizeHint)
+    {
+        const size_t chunk = 1 << 16;
+        owned.clear();
+        owned.reserve(sizeHint + 1);
+        size_t used = 0;
+        while(true)
+        {
+            if(owned.size() < used + chunk)
+                owned.resize(std::max(owned.capacity(), used + chunk));
+            ssize_t n = read(fd, &owned[used], owned.size() - used);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+                return false;
+            if(n == 0)
+                break;
+            used += size_t(n);
+        }
+        owned.resize(used);
+        text = owned;
+        return true;
+    }
+
+public:
+    SourceBuffer()
+        : mapped(nullptr)
+        , mappedSize(0)
+        {}
+
+    ~SourceBuffer()
+    {
+        unmap();
+    }
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    // Function to load the source from an already open descriptor
+    bool load(int fd)
+    {
+        unmap();
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+            return false;
+        if(S_ISREG(st.st_mode) && st.st_size > 0
+           && mapFile(fd, size_t(st.st_size)))
+            return true;
+        return readAll(fd, S_ISREG(st.st_mode) ? size_t(st.st_size) : 0);
+    }
+
+    // Function to load the source from a file path
+    bool open(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0)
+            return false;
+        bool ok = load(fd);
+        close(fd); // 映射建立后即可关闭描述符
+        return ok;
+    }
+
+    bool loadStdin()
+    {
+        return load(STDIN_FILENO);
+    }
+
+    // Function to make sure a non-empty source ends with '\n'
+    // 与按行读入再补 "\n" 的旧行为保持一致；只有缺少末尾换行时才会拷贝一次
+    void ensureTrailingNewline()
+    {
+        if(text.empty() || text.back() == '\n')
+            return;
+        std::string copy;
+        copy.reserve(text.size() + 1);
+        copy.append(text.data(), text.size());
+        copy.push_back('\n');
+        unmap();
+        owned.swap(copy);
+        text = owned;
+    }
+
+    std::string_view view() const { return text; }
+    size_t size() const { return text.size(); }
+    bool isMapped() const { return mapped != nullptr; }
+};
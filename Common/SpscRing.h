@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// 单生产者/单消费者的有界环形队列，无锁：两端各自只写自己的下标，用 acquire/release 交接槽位。
+// 槽位里的对象一直留在队列中反复使用，生产者原地填写、消费者原地读取，
+// 所以像 vector 这样的成员在预热之后不会再分配内存。
+// 两个下标分在不同的缓存行上，各端还缓存了对端的下标，只有看起来满（或空）时才去读对端。
+template<class T>
+class SpscRing {
+private:
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> slots;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> head; // 下一个要读的槽，只有消费者写
+    size_t cachedTail;                            // 消费者看到的 tail
+    alignas(CACHE_LINE) std::atomic<size_t> tail; // 下一个要写的槽，只有生产者写
+    size_t cachedHead;                            // 生产者看到的 head
+
+public:
+    // capacity 必须是 2 的幂
+    explicit SpscRing(size_t capacity)
+        : slots(capacity)
+        , mask(capacity - 1)
+        , head(0)
+        , cachedTail(0)
+        , tail(0)
+        , cachedHead(0)
+    {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Function for the producer to get the next free slot, nullptr when the ring is full
+    T* tryBeginWrite()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - cachedHead == slots.size())
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if(t - cachedHead == slots.size())
+                return nullptr;
+        }
+        return &slots[t & mask];
+    }
+
+    // Function for the producer to publish the slot returned by tryBeginWrite()
+    void commitWrite()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Function for the consumer to get the oldest filled slot, nullptr when the ring is empty
+    T* tryBeginRead()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if(h == cachedTail)
+                return nullptr;
+        }
+        return &slots[h & mask];
+    }
+
+    // Function for the consumer to hand the slot returned by tryBeginRead() back to the producer
+    void commitRead()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Enum class to define the exact kind of a token
+// 每个关键字、运算符、界符各占一个枚举值，语法分析只需做整数比较
+enum class TokenKind : uint8_t {
+    IDENTIFIER,
+    INTEGER_LITERAL,
+    // keywords
+    KW_INT, KW_IF, KW_ELSE, KW_WHILE, KW_BREAK, KW_CONTINUE, KW_RETURN, KW_VOID,
+    // operators，关系运算符保持连续，方便按区间判断
+    OP_PLUS, OP_MINUS, OP_MUL, OP_DIV, OP_MOD,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_AND, OP_OR, OP_NOT, OP_ASSIGN,
+    OP_AMP, OP_PIPE, // 单独的 & 和 |，文法中不使用
+    // punctuators
+    P_LPAREN, P_RPAREN, P_LBRACE, P_RBRACE, P_SEMI, P_COMMA,
+    UNKNOWN,
+    END_OF_FILE
+};
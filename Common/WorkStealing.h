@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取：count 个互不依赖的任务先按连续的区间平均分给每个线程，
+// 各线程从自己队列的前端取任务，自己的做完后从别的线程队列的后端偷，
+// 这样相邻的任务大多在同一个线程上做，某个区间特别慢时也不会拖住其余线程。
+// 任务在运行中不会产生新任务，所以所有队列都空了就可以结束。
+
+// Function to run task(i) for every i in [0, count) on the given number of threads
+// 调用线程自己也是其中一个工作线程；threads 为 0 或 1 时就在调用线程上按顺序执行
+template<class F>
+void runWorkStealing(size_t count, unsigned threads, F&& task)
+{
+    if(threads > count)
+        threads = unsigned(count);
+    if(threads <= 1)
+    {
+        for(size_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+    std::vector<WorkQueue> queues(threads);
+    for(unsigned w = 0; w < threads; w++)
+    {
+        for(size_t i = count * w / threads; i < count * (w + 1) / threads; i++)
+            queues[w].items.push_back(i);
+    }
+
+    auto worker = [&](unsigned self) {
+        while(true)
+        {
+            size_t item = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                if(!queues[self].items.empty())
+                {
+                    item = queues[self].items.front();
+                    queues[self].items.pop_front();
+                    found = true;
+                }
+            }
+            for(unsigned k = 1; !found && k < threads; k++)
+            {
+                WorkQueue& victim = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if(!victim.items.empty())
+                {
+                    item = victim.items.back();
+                    victim.items.pop_back();
+                    found = true;
+                }
+            }
+            if(!found)
+                return;
+            task(item);
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    helpers.reserve(threads - 1);
+    for(unsigned w = 1; w < threads; w++)
+        helpers.emplace_back(worker, w);
+    worker(0);
+    for(std::thread& helper : helpers)
+        helper.join();
+}
@@ -1,4 +1,9 @@
 #include<bits/stdc++.h>
+#include "../Common/CharClass.h"
+#include "../Common/Keywords.h"
+#include "../Common/OutputBuffer.h"
+#include "../Common/Scan.h"
+#include "../Common/SourceBuffer.h"
 using namespace std;
 
 // Enum class to define different types of tokens
@@ -11,92 +16,40 @@ enum class TokenType {
     UNKNOWN
 };
 
-// Struct to represent a token with its type and value
+// Struct to represent a token with its type and position
+// token 不再持有自己的字符串，只记录在源码缓冲区中的偏移和长度
 struct Token {
     TokenType type;
-    string value;
+    uint32_t offset;
+    uint32_t length;
 
-    Token(TokenType t, const string& v)
+    Token(TokenType t, uint32_t off, uint32_t len)
         : type(t)
-        , value(v)
+        , offset(off)
+        , length(len)
         {}
+
+    // Function to get the token text, only materialized on demand
+    string_view text(string_view source) const
+    {
+        return string_view(source.data() + offset, length);
+    }
 };
 
 // Class that implements the lexical analyzer
 class LexicalAnalyzer {
 private:
-    string input;
+    string_view input; // 指向调用者持有的源码缓冲区，词法分析器本身不拷贝
     size_t position;
-    unordered_map<string, TokenType> keywords;
-
-    // Function to initialize the keywords map
-    void initKeywords()
-    {
-        keywords["int"] = TokenType::KEYWORD;
-        keywords["if"] = TokenType::KEYWORD;
-        keywords["else"] = TokenType::KEYWORD;
-        keywords["while"] = TokenType::KEYWORD;
-        keywords["break"] = TokenType::KEYWORD;
-        keywords["continue"] = TokenType::KEYWORD;
-        keywords["return"] = TokenType::KEYWORD;
-        keywords["void"] = TokenType::KEYWORD;
-    }
-
-    // Function to check if a character is whitespace
-    bool isWhitespace(char c)
-    {
-        return c == ' ' || c == '\t' || c == '\n'
-                || c == '\r';
-    }
-
-    // Function to check if a character is alphabetic
-    bool isAlpha(char c)
-    {
-        return (c >= 'a' && c <= 'z')
-                || (c >= 'A' && c <= 'Z');
-    }
-
-    // Function to check if a character is digit
-    bool isDigit(char c)
-    {
-        return c >= '0' && c <= '9';
-    }
-
-    // Function to check if a character is alphanumeric
-    bool isAlphaNumeric(char c)
-    {
-        return isAlpha(c) || isDigit(c);
-    }
-
-    // Function to check if a character is a operator
-    bool isOperator(char c)
-    {
-        return c == '+' || c == '-' || c == '*' || c == '/' || c == '%'
-                || c == '=' || c == '<' || c == '>' || c == '!'
-                || c == '&' || c == '|';
-    }
-
-    // Function to check if a character is a punctuator
-    bool isPunctuator(char c)
-    {
-        return c == '(' || c == ')' || c == '{' || c == '}'
-                || c == ';' || c == ',';
-    }
-    
-    // Function to check if a character is a underscore
-    bool isUnderscore(char c)
-    {
-        return c == '_';
-    }
 
     // Function to skip LineComment
     void skipLineComment()
     {
         if(position +1 < input.length() && input[position] == '/' && input[position+1] == '/')
             position += 2;
-        while(position < input.length() && input[position] != '\n')
-            position++;
-        if(position < input.length() && input[position] == '\n')
+        const char* begin = input.data();
+        position = scanFindByte(begin + position, begin + input.length(), '\n') - begin;
+        if(position < input.length())
             position++;
     }
 
@@ -105,35 +58,44 @@ private:
     {
         if(position+1 < input.length() && input[position] == '/' && input[position+1] == '*')
             position += 2;
-        while(position+1 < input.length())
+        if(position+1 >= input.length())
         {
-            if(input[position] == '*' && input[position+1] == '/')
+            position = input.length();
+            return;
+        }
+        // 只在 [p, last) 中找 '*'，保证 '*' 后面还有一个字符可看
+        const char* begin = input.data();
+        const char* p = begin + position;
+        const char* last = begin + input.length() - 1;
+        while(true)
+        {
+            const char* star = scanFindByte(p, last, '*');
+            if(star == last)
+                break;
+            if(star[1] == '/')
             {
-                position += 2;
+                position = star - begin + 2;
                 return ;
             }
-            position++;
+            p = star + 1;
         }
         position = input.length(); // 当最后没有终结*/的时候，到了程序结尾
     }
 
     // Function to get the next word
-    string getNextWord()
+    string_view getNextWord()
     {
         size_t start = position;
-        while(position < input.length()
-               && (isAlphaNumeric(input[position]) || isUnderscore(input[position])))
-        {
-            position++;
-        }
+        const char* begin = input.data();
+        position = scanIdentifierEnd(begin + position, begin + input.length()) - begin;
         return input.substr(start, position - start);
     }
 
     // Function to get the next number
-    string getNextNumber()
+    string_view getNextNumber()
     {
         size_t start = position;
-        while(position < input.length() && isDigit(input[position]))
+        while(position < input.length() && (charClassOf(input[position]) & CHAR_DIGIT))
         {
             position++;
         }
@@ -141,10 +103,10 @@ private:
     }
 
     // Function to get the next operator
-    string getNextOperator()
+    string_view getNextOperator()
     {
         size_t start = position;
-        string two;
+        string_view two;
         if(start + 1 < input.length())
         {
             two = input.substr(start, 2);
@@ -160,21 +122,25 @@ private:
         return input.substr(start, 1);
     }
 
-    string getNextPunctuator()
+    string_view getNextPunctuator()
     {
         size_t start = position;
         position++;
         return input.substr(start, 1);
     }
 
+    // Function to build a token from a slice of the input
+    Token makeToken(TokenType type, string_view text)
+    {
+        return Token(type, uint32_t(text.data() - input.data()), uint32_t(text.size()));
+    }
+
 public: 
     // Constructor for LexicalAnalyzer
-    LexicalAnalyzer(const string& source)
+    LexicalAnalyzer(string_view source)
         : input(source)
         , position(0)
-    {
-        initKeywords();
-    }
+    {}
 
     // Function to tokenize the input string
     vector<Token> tokenize()
@@ -184,31 +150,33 @@ public:
         while(position < input.length())
         {
             char currentChar = input[position];
+            uint8_t charClass = charClassOf(currentChar); // 一次查表得到该字符的全部分类
 
             // Skip whitespace
-            if(isWhitespace(currentChar))
+            if(charClass & CHAR_WHITESPACE)
             {
-                position++;
+                const char* begin = input.data();
+                position = scanWhitespaceEnd(begin + position, begin + input.length()) - begin;
                 continue;
             }
 
             // Identify keywords or identifiers 还有下划线开头
-            if(isAlpha(currentChar) || isUnderscore(currentChar))
+            if(charClass & CHAR_IDENT_START)
             {
-                string word = getNextWord();
-                if(keywords.find(word) != keywords.end()) //identify keywords
+                string_view word = getNextWord();
+                if(lookupKeyword(word) != TokenKind::IDENTIFIER) //identify keywords
                 {
-                    tokens.emplace_back(TokenType::KEYWORD, word);
+                    tokens.push_back(makeToken(TokenType::KEYWORD, word));
                 }
                 else 
                 {
-                    tokens.emplace_back(TokenType::IDENTIFIER, word);
+                    tokens.push_back(makeToken(TokenType::IDENTIFIER, word));
                 }
             }
-            else if(isDigit(currentChar)) // identify integer
+            else if(charClass & CHAR_DIGIT) // identify integer
             {
-                string number = getNextNumber();
-                tokens.emplace_back(TokenType::INTEGER_LITERAL, number);
+                string_view number = getNextNumber();
+                tokens.push_back(makeToken(TokenType::INTEGER_LITERAL, number));
             }
             else if(currentChar == '/') //遇到/的时候判断是注释还是运算符
             {
@@ -224,23 +192,23 @@ public:
                 }
                 else
                 {
-                    string op = getNextOperator();
-                    tokens.emplace_back(TokenType::OPERATOR,op);
+                    string_view op = getNextOperator();
+                    tokens.push_back(makeToken(TokenType::OPERATOR, op));
                 }
             }
-            else if(isOperator(currentChar))
+            else if(charClass & CHAR_OPERATOR)
             {
-                string op = getNextOperator(); 
-                tokens.emplace_back(TokenType::OPERATOR, op);
+                string_view op = getNextOperator(); 
+                tokens.push_back(makeToken(TokenType::OPERATOR, op));
             }
-            else if(isPunctuator(currentChar))
+            else if(charClass & CHAR_PUNCTUATOR)
             {
-                string punct = getNextPunctuator();
-                tokens.emplace_back(TokenType::PUNCTUATOR, punct);
+                string_view punct = getNextPunctuator();
+                tokens.push_back(makeToken(TokenType::PUNCTUATOR, punct));
             }
             else // unknown character
             {
-                tokens.emplace_back(TokenType::UNKNOWN, string(1, currentChar));
+                tokens.push_back(makeToken(TokenType::UNKNOWN, input.substr(position, 1)));
                 position++;
             }
         }
@@ -249,69 +217,76 @@ public:
     }
 };
 
-// all functions below for print name
-string getKeyWordName(const Token& token)
-{
-    return string("'") + token.value + "'";
-}
-
-
-string getOperatorName(const Token& token)
-{
-    return string("'") + token.value + "'";
-}
-
-string getPunctuatorName(const Token& token)
-{
-    return string("'") + token.value + "'";
-}
-
-// Function to convert TokenType to string for printing 
-string getTokenTypeName(TokenType type, const Token& token)
+// Function to write the printed name of a token's type
+// 关键字、运算符、界符打印为带单引号的原文，其余打印固定的名字
+void writeTokenTypeName(OutputBuffer& out, TokenType type, const Token& token, string_view source)
 {
     switch(type)
     {
         case TokenType::KEYWORD:
-            return getKeyWordName(token);
-        case TokenType::IDENTIFIER:
-            return "Ident";
-        case TokenType::INTEGER_LITERAL:
-            return "IntConst";
         case TokenType::OPERATOR:
-            return getOperatorName(token);
         case TokenType::PUNCTUATOR:
-            return getPunctuatorName(token);
+            out.append('\'');
+            out.append(token.text(source));
+            out.append('\'');
+            return;
+        case TokenType::IDENTIFIER:
+            out.append("Ident");
+            return;
+        case TokenType::INTEGER_LITERAL:
+            out.append("IntConst");
+            return;
         case TokenType::UNKNOWN:
-            return "Unknown";
+            out.append("Unknown");
+            return;
         default:
-            return "UNDEFINED";
+            out.append("UNDEFINED");
+            return;
     }
 }
 
 // Function to print all tokens
-void printTokens(const vector<Token>& tokens)
+// 每行 N:类型:"原文"，格式化进一块大缓冲区，攒满了才 write() 一次，不再每个 token 刷新一次 cout
+void printTokens(const vector<Token>& tokens, string_view source)
 {
-    int count = 0;
+    cout.flush(); // 之前经 cout 输出的内容要排在前面
+    OutputBuffer out(STDOUT_FILENO);
+    size_t count = 0;
     for(const auto& token : tokens)
     {
-        cout << count++ <<":" << getTokenTypeName(token.type, token)
-        <<":"<<"\"" << token.value << "\"" << endl;
+        out.appendUnsigned(count++);
+        out.append(':');
+        writeTokenTypeName(out, token.type, token, source);
+        out.append(":\"");
+        out.append(token.text(source));
+        out.append("\"\n");
     }
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    string sourceCode;
-    std::ostringstream ss;
-    ss << std::cin.rdbuf();
-    sourceCode = ss.str();
+    // 给出文件参数时直接映射该文件，否则读取标准输入
+    SourceBuffer source;
+    const char* inputName = argc > 1 ? argv[1] : "<stdin>";
+    if(!(argc > 1 ? source.open(argv[1]) : source.loadStdin()))
+    {
+        cerr << "cannot read " << inputName << endl;
+        return 1;
+    }
+    string_view sourceCode = source.view();
+
+    if(sourceCode.length() > UINT32_MAX) // token 只记录 32 位偏移
+    {
+        cerr << "source file too large" << endl;
+        return 1;
+    }
 
     LexicalAnalyzer lexer(sourceCode);
 
     vector<Token> tokens = lexer.tokenize();
 
     //cout << "Tokens Generate by Lexical Analyzer:" << endl;
-    printTokens(tokens);
+    printTokens(tokens, sourceCode);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,597 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "../Common/Arena.h"
+#include "../Common/DeepStack.h"
+#include "../Common/TokenKind.h"
+
+// 抽象语法树：所有节点都分配在 Arena 里，随 Arena 一次性释放
+// 节点不持有字符串，只记录源码中的位置；语法错误处的子节点可能为空指针
+// 名字旁边另记词法分析驻留得到的符号 ID，没有驻留时为 Interner::NONE，用到时再按位置上的文字驻留
+
+// Struct to represent a range of the source text
+struct SourceSpan {
+    uint32_t offset;
+    uint32_t length;
+
+    std::string_view text(std::string_view source) const
+    {
+        return source.substr(offset, length);
+    }
+
+    // Function to get the span covering both a and b
+    static SourceSpan join(SourceSpan a, SourceSpan b)
+    {
+        uint32_t begin = a.offset < b.offset ? a.offset : b.offset;
+        uint32_t endA = a.offset + a.length;
+        uint32_t endB = b.offset + b.length;
+        return SourceSpan{begin, (endA > endB ? endA : endB) - begin};
+    }
+};
+
+// Struct to represent a list of child nodes, the array lives in the arena
+template<class T>
+struct NodeList {
+    T** items;
+    uint32_t count;
+
+    T** begin() const { return items; }
+    T** end() const { return items + count; }
+    uint32_t size() const { return count; }
+    T* operator[](uint32_t i) const { return items[i]; }
+};
+
+enum class ExprKind : uint8_t {
+    INT_LITERAL, // 123
+    NAME,        // a
+    CALL,        // f(a, b)
+    UNARY,       // -a  !a  +a
+    BINARY,      // a + b，op 为运算符的 TokenKind
+};
+
+struct Expr {
+    ExprKind kind;
+    SourceSpan span;
+};
+
+struct IntLiteralExpr : Expr {};
+
+struct NameExpr : Expr {
+    uint32_t symbol;
+};
+
+struct CallExpr : Expr {
+    SourceSpan callee;
+    uint32_t symbol; // callee 的符号 ID
+    NodeList<Expr> args;
+};
+
+struct UnaryExpr : Expr {
+    TokenKind op;
+    Expr* operand;
+};
+
+struct BinaryExpr : Expr {
+    TokenKind op;
+    Expr* lhs;
+    Expr* rhs;
+};
+
+enum class StmtKind : uint8_t {
+    BLOCK,    // { ... }
+    EXPR,     // f(a);  a;
+    ASSIGN,   // a = Expr;
+    DECL,     // int a = Expr, b;
+    IF,
+    WHILE,
+    BREAK,
+    CONTINUE,
+    RETURN,   // value 为空表示 return;
+};
+
+struct Stmt {
+    StmtKind kind;
+    SourceSpan span;
+};
+
+struct BlockStmt : Stmt {
+    NodeList<Stmt> stmts;
+};
+
+struct ExprStmt : Stmt {
+    Expr* expr;
+};
+
+struct AssignStmt : Stmt {
+    SourceSpan name;
+    uint32_t symbol;
+    Expr* value;
+};
+
+// Struct to represent one declarator of a DeclStmt, init is null without "= Expr"
+struct VarDecl {
+    SourceSpan name;
+    uint32_t symbol;
+    Expr* init;
+};
+
+struct DeclStmt : Stmt {
+    NodeList<VarDecl> vars;
+};
+
+struct IfStmt : Stmt {
+    Expr* cond;
+    Stmt* thenStmt;
+    Stmt* elseStmt; // 没有 else 时为空
+};
+
+struct WhileStmt : Stmt {
+    Expr* cond;
+    Stmt* body;
+};
+
+struct ReturnStmt : Stmt {
+    Expr* value;
+};
+
+struct Param {
+    SourceSpan name;
+    uint32_t symbol;
+};
+
+struct FuncDef {
+    TokenKind returnType; // KW_INT 或 KW_VOID
+    SourceSpan name;
+    uint32_t symbol;
+    NodeList<Param> params;
+    BlockStmt* body;
+};
+
+struct CompUnit {
+    NodeList<FuncDef> funcs;
+};
+
+// Class that owns the nodes of one AST
+class AstArena {
+private:
+    Arena arena;
+
+public:
+    template<class T>
+    T* make(const T& node)
+    {
+        return arena.make<T>(node);
+    }
+
+    // Function to copy a list of nodes collected as void* into the arena
+    template<class T>
+    NodeList<T> makeList(void* const* items, size_t count)
+    {
+        if(count == 0)
+            return NodeList<T>{nullptr, 0};
+        T** out = static_cast<T**>(arena.allocate(sizeof(T*) * count, alignof(T*)));
+        for(size_t i = 0; i < count; i++)
+            out[i] = static_cast<T*>(items[i]);
+        return NodeList<T>{out, uint32_t(count)};
+    }
+
+    size_t bytesUsed() const { return arena.bytesUsed(); }
+    size_t bytesReserved() const { return arena.bytesReserved(); }
+};
+
+// 语法分析器通过 Builder 建树：parse 函数只调用 Builder 的方法，树的表示由 Builder 决定
+// Builder 需要提供 BUILDS_TREE、各种 Ref 类型、mark()/push() 收集子节点列表，以及下面的各个构造方法；
+// noExpr()/noStmt() 表示可选部分不存在，errorXxx() 表示该处有语法错误；
+// 名字都带着它的符号 ID（见 Cursor 的 symbol()），不需要的 Builder 可以不记
+
+// Struct to represent the empty result of NullAstBuilder
+struct AstNone {};
+
+// Class that builds nothing, the parser then only checks the input
+class NullAstBuilder {
+public:
+    static const bool BUILDS_TREE = false;
+    typedef AstNone ExprRef;
+    typedef AstNone StmtRef;
+    typedef AstNone VarRef;
+    typedef AstNone ParamRef;
+    typedef AstNone FuncRef;
+    typedef AstNone UnitRef;
+
+    size_t mark() const { return 0; }
+    void push(AstNone) {}
+
+    AstNone noExpr() { return AstNone(); }
+    AstNone noStmt() { return AstNone(); }
+    AstNone errorExpr(SourceSpan) { return AstNone(); }
+    AstNone errorStmt(SourceSpan) { return AstNone(); }
+    AstNone errorVar(SourceSpan) { return AstNone(); }
+    AstNone errorParam(SourceSpan) { return AstNone(); }
+    AstNone errorFunc(SourceSpan) { return AstNone(); }
+
+    AstNone intLiteral(SourceSpan) { return AstNone(); }
+    AstNone name(SourceSpan, uint32_t) { return AstNone(); }
+    AstNone call(SourceSpan, SourceSpan, uint32_t, size_t) { return AstNone(); }
+    AstNone unary(SourceSpan, TokenKind, AstNone) { return AstNone(); }
+    AstNone binary(SourceSpan, TokenKind, AstNone, AstNone) { return AstNone(); }
+
+    AstNone block(SourceSpan, size_t) { return AstNone(); }
+    AstNone exprStmt(SourceSpan, AstNone) { return AstNone(); }
+    AstNone assign(SourceSpan, SourceSpan, uint32_t, AstNone) { return AstNone(); }
+    AstNone varDecl(SourceSpan, uint32_t, AstNone) { return AstNone(); }
+    AstNone decl(SourceSpan, size_t) { return AstNone(); }
+    AstNone ifStmt(SourceSpan, AstNone, AstNone, AstNone) { return AstNone(); }
+    AstNone whileStmt(SourceSpan, AstNone, AstNone) { return AstNone(); }
+    AstNone breakStmt(SourceSpan) { return AstNone(); }
+    AstNone continueStmt(SourceSpan) { return AstNone(); }
+    AstNone returnStmt(SourceSpan, AstNone) { return AstNone(); }
+
+    AstNone param(SourceSpan, uint32_t) { return AstNone(); }
+    AstNone funcDef(TokenKind, SourceSpan, uint32_t, size_t, AstNone) { return AstNone(); }
+    AstNone compUnit(size_t) { return AstNone(); }
+};
+
+// Class that builds the pointer-based AST into an AstArena
+// 出错的位置用空指针表示，列表里不放空指针
+class ArenaAstBuilder {
+private:
+    AstArena* ast;
+    std::vector<void*> scratch; // 正在构造的子节点列表，嵌套的列表共用这一个栈
+
+    template<class T>
+    NodeList<T> finish(size_t mark)
+    {
+        NodeList<T> list = ast->makeList<T>(scratch.data() + mark, scratch.size() - mark);
+        scratch.resize(mark);
+        return list;
+    }
+
+public:
+    static const bool BUILDS_TREE = true;
+    typedef Expr* ExprRef;
+    typedef Stmt* StmtRef;
+    typedef VarDecl* VarRef;
+    typedef Param* ParamRef;
+    typedef FuncDef* FuncRef;
+    typedef CompUnit* UnitRef;
+
+    explicit ArenaAstBuilder(AstArena& arena)
+        : ast(&arena)
+    {}
+
+    size_t mark() const { return scratch.size(); }
+
+    template<class T>
+    void push(T* item)
+    {
+        if(item != nullptr)
+            scratch.push_back(item);
+    }
+
+    Expr* noExpr() { return nullptr; }
+    Stmt* noStmt() { return nullptr; }
+    Expr* errorExpr(SourceSpan) { return nullptr; }
+    Stmt* errorStmt(SourceSpan) { return nullptr; }
+    VarDecl* errorVar(SourceSpan) { return nullptr; }
+    Param* errorParam(SourceSpan) { return nullptr; }
+    FuncDef* errorFunc(SourceSpan) { return nullptr; }
+
+    Expr* intLiteral(SourceSpan span)
+    {
+        return ast->make(IntLiteralExpr{{ExprKind::INT_LITERAL, span}});
+    }
+
+    Expr* name(SourceSpan span, uint32_t symbol)
+    {
+        return ast->make(NameExpr{{ExprKind::NAME, span}, symbol});
+    }
+
+    Expr* call(SourceSpan span, SourceSpan callee, uint32_t symbol, size_t argMark)
+    {
+        return ast->make(CallExpr{{ExprKind::CALL, span}, callee, symbol, finish<Expr>(argMark)});
+    }
+
+    Expr* unary(SourceSpan span, TokenKind op, Expr* operand)
+    {
+        return ast->make(UnaryExpr{{ExprKind::UNARY, span}, op, operand});
+    }
+
+    Expr* binary(SourceSpan span, TokenKind op, Expr* lhs, Expr* rhs)
+    {
+        return ast->make(BinaryExpr{{ExprKind::BINARY, span}, op, lhs, rhs});
+    }
+
+    Stmt* block(SourceSpan span, size_t stmtMark)
+    {
+        return ast->make(BlockStmt{{StmtKind::BLOCK, span}, finish<Stmt>(stmtMark)});
+    }
+
+    Stmt* exprStmt(SourceSpan span, Expr* expr)
+    {
+        return ast->make(ExprStmt{{StmtKind::EXPR, span}, expr});
+    }
+
+    Stmt* assign(SourceSpan span, SourceSpan name, uint32_t symbol, Expr* value)
+    {
+        return ast->make(AssignStmt{{StmtKind::ASSIGN, span}, name, symbol, value});
+    }
+
+    VarDecl* varDecl(SourceSpan name, uint32_t symbol, Expr* init)
+    {
+        return ast->make(VarDecl{name, symbol, init});
+    }
+
+    Stmt* decl(SourceSpan span, size_t varMark)
+    {
+        return ast->make(DeclStmt{{StmtKind::DECL, span}, finish<VarDecl>(varMark)});
+    }
+
+    Stmt* ifStmt(SourceSpan span, Expr* cond, Stmt* thenStmt, Stmt* elseStmt)
+    {
+        return ast->make(IfStmt{{StmtKind::IF, span}, cond, thenStmt, elseStmt});
+    }
+
+    Stmt* whileStmt(SourceSpan span, Expr* cond, Stmt* body)
+    {
+        return ast->make(WhileStmt{{StmtKind::WHILE, span}, cond, body});
+    }
+
+    Stmt* breakStmt(SourceSpan span)
+    {
+        return ast->make(Stmt{StmtKind::BREAK, span});
+    }
+
+    Stmt* continueStmt(SourceSpan span)
+    {
+        return ast->make(Stmt{StmtKind::CONTINUE, span});
+    }
+
+    Stmt* returnStmt(SourceSpan span, Expr* value)
+    {
+        return ast->make(ReturnStmt{{StmtKind::RETURN, span}, value});
+    }
+
+    Param* param(SourceSpan name, uint32_t symbol)
+    {
+        return ast->make(Param{name, symbol});
+    }
+
+    // body 来自 parseBlock，只可能是 BlockStmt 或空指针
+    FuncDef* funcDef(TokenKind returnType, SourceSpan name, uint32_t symbol, size_t paramMark, Stmt* body)
+    {
+        NodeList<Param> params = finish<Param>(paramMark);
+        return ast->make(FuncDef{returnType, name, symbol, params, static_cast<BlockStmt*>(body)});
+    }
+
+    CompUnit* compUnit(size_t funcMark)
+    {
+        return ast->make(CompUnit{finish<FuncDef>(funcMark)});
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// 以 S 表达式打印语法树，供 --dump-ast 使用
+class AstPrinter {
+private:
+    std::ostream& out;
+    std::string_view source;
+    int depth;
+    DeepStack deepStack; // 语法分析能接受的深度，打印时同样要走得下去
+
+    void indent()
+    {
+        for(int i = 0; i < depth; i++)
+            out << "  ";
+    }
+
+    void printExpr(const Expr* expr)
+    {
+        deepStack.recurse([&] {
+            printExprBody(expr);
+            return true;
+        });
+    }
+
+    void printExprBody(const Expr* expr)
+    {
+        if(expr == nullptr)
+        {
+            out << "<error>";
+            return;
+        }
+        switch(expr->kind)
+        {
+            case ExprKind::INT_LITERAL:
+            case ExprKind::NAME:
+                out << expr->span.text(source);
+                break;
+            case ExprKind::CALL:
+            {
+                const CallExpr* call = static_cast<const CallExpr*>(expr);
+                out << "(call " << call->callee.text(source);
+                for(const Expr* arg : call->args)
+                {
+                    out << " ";
+                    printExpr(arg);
+                }
+                out << ")";
+                break;
+            }
+            case ExprKind::UNARY:
+            {
+                const UnaryExpr* unary = static_cast<const UnaryExpr*>(expr);
+                out << "(" << operatorSpelling(unary->op) << " ";
+                printExpr(unary->operand);
+                out << ")";
+                break;
+            }
+            case ExprKind::BINARY:
+            {
+                const BinaryExpr* binary = static_cast<const BinaryExpr*>(expr);
+                out << "(" << operatorSpelling(binary->op) << " ";
+                printExpr(binary->lhs);
+                out << " ";
+                printExpr(binary->rhs);
+                out << ")";
+                break;
+            }
+        }
+    }
+
+    void printStmt(const Stmt* stmt)
+    {
+        deepStack.recurse([&] {
+            printStmtBody(stmt);
+            return true;
+        });
+    }
+
+    void printStmtBody(const Stmt* stmt)
+    {
+        indent();
+        if(stmt == nullptr)
+        {
+            out << "<error>\n";
+            return;
+        }
+        switch(stmt->kind)
+        {
+            case StmtKind::BLOCK:
+            {
+                out << "(block\n";
+                depth++;
+                for(const Stmt* s : static_cast<const BlockStmt*>(stmt)->stmts)
+                    printStmt(s);
+                depth--;
+                indent();
+                out << ")\n";
+                return;
+            }
+            case StmtKind::EXPR:
+                out << "(expr ";
+                printExpr(static_cast<const ExprStmt*>(stmt)->expr);
+                out << ")\n";
+                return;
+            case StmtKind::ASSIGN:
+            {
+                const AssignStmt* assign = static_cast<const AssignStmt*>(stmt);
+                out << "(assign " << assign->name.text(source) << " ";
+                printExpr(assign->value);
+                out << ")\n";
+                return;
+            }
+            case StmtKind::DECL:
+            {
+                out << "(int";
+                for(const VarDecl* var : static_cast<const DeclStmt*>(stmt)->vars)
+                {
+                    out << " " << var->name.text(source);
+                    if(var->init != nullptr)
+                    {
+                        out << "=";
+                        printExpr(var->init);
+                    }
+                }
+                out << ")\n";
+                return;
+            }
+            case StmtKind::IF:
+            {
+                const IfStmt* ifStmt = static_cast<const IfStmt*>(stmt);
+                out << "(if ";
+                printExpr(ifStmt->cond);
+                out << "\n";
+                depth++;
+                printStmt(ifStmt->thenStmt);
+                if(ifStmt->elseStmt != nullptr)
+                    printStmt(ifStmt->elseStmt);
+                depth--;
+                indent();
+                out << ")\n";
+                return;
+            }
+            case StmtKind::WHILE:
+            {
+                const WhileStmt* whileStmt = static_cast<const WhileStmt*>(stmt);
+                out << "(while ";
+                printExpr(whileStmt->cond);
+                out << "\n";
+                depth++;
+                printStmt(whileStmt->body);
+                depth--;
+                indent();
+                out << ")\n";
+                return;
+            }
+            case StmtKind::BREAK:
+                out << "(break)\n";
+                return;
+            case StmtKind::CONTINUE:
+                out << "(continue)\n";
+                return;
+            case StmtKind::RETURN:
+            {
+                const ReturnStmt* ret = static_cast<const ReturnStmt*>(stmt);
+                out << "(return";
+                if(ret->value != nullptr)
+                {
+                    out << " ";
+                    printExpr(ret->value);
+                }
+                out << ")\n";
+                return;
+            }
+        }
+    }
+
+public:
+    static const char* operatorSpelling(TokenKind op)
+    {
+        switch(op)
+        {
+            case TokenKind::OP_PLUS:  return "+";
+            case TokenKind::OP_MINUS: return "-";
+            case TokenKind::OP_MUL:   return "*";
+            case TokenKind::OP_DIV:   return "/";
+            case TokenKind::OP_MOD:   return "%";
+            case TokenKind::OP_LT:    return "<";
+            case TokenKind::OP_LE:    return "<=";
+            case TokenKind::OP_GT:    return ">";
+            case TokenKind::OP_GE:    return ">=";
+            case TokenKind::OP_EQ:    return "==";
+            case TokenKind::OP_NE:    return "!=";
+            case TokenKind::OP_AND:   return "&&";
+            case TokenKind::OP_OR:    return "||";
+            case TokenKind::OP_NOT:   return "!";
+            default:                  return "?";
+        }
+    }
+
+    AstPrinter(std::ostream& output, std::string_view text)
+        : out(output)
+        , source(text)
+        , depth(0)
+    {}
+
+    void print(const CompUnit* unit)
+    {
+        if(unit == nullptr)
+            return;
+        for(const FuncDef* func : unit->funcs)
+        {
+            out << "(func " << (func->returnType == TokenKind::KW_INT ? "int " : "void ")
+                << func->name.text(source) << " (";
+            for(uint32_t i = 0; i < func->params.size(); i++)
+                out << (i > 0 ? " " : "") << func->params[i]->name.text(source);
+            out << ")\n";
+            depth++;
+            printStmt(func->body);
+            depth--;
+            out << ")\n";
+        }
+    }
+};
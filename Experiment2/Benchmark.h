@@ -0,0 +1,400 @@
+#pragma once
+
+// Benchmark driver for the lexer and parser
+// 只在 SyntaxAnalyzerBench 目标（定义了 SYNTAX_BENCH）中由 SyntaxAnalyzer.cpp 末尾包含，直接使用其中的类
+// usage: SyntaxAnalyzerBench [--iterations N] [--synthetic MB] [--threads N] [file...]
+
+// 统计全局 operator new 的调用次数，用来确认语法分析阶段不分配内存
+// 整组 new / delete（数组、带大小、nothrow、对齐）一起替换，分配和释放始终配对使用 malloc 系列
+atomic<size_t> benchAllocations(0);
+
+// Function to allocate for every replaced operator new, nullptr when out of memory
+void* benchAllocate(size_t size, size_t align)
+{
+    benchAllocations.fetch_add(1, memory_order_relaxed);
+    if(size == 0)
+        size = 1;
+    if(align <= alignof(max_align_t))
+        return malloc(size);
+    void* p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+void* benchAllocateOrThrow(size_t size, size_t align)
+{
+    if(void* p = benchAllocate(size, align))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size) { return benchAllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return benchAllocateOrThrow(size, 0); }
+void* operator new(size_t size, align_val_t align) { return benchAllocateOrThrow(size, size_t(align)); }
+void* operator new[](size_t size, align_val_t align) { return benchAllocateOrThrow(size, size_t(align)); }
+void* operator new(size_t size, const nothrow_t&) noexcept { return benchAllocate(size, 0); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return benchAllocate(size, 0); }
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept { return benchAllocate(size, size_t(align)); }
+void* operator new[](size_t size, align_val_t align, const nothrow_t&) noexcept { return benchAllocate(size, size_t(align)); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { free(p); }
+
+// Function to run f several times and return the best wall time in milliseconds
+template<class F>
+double benchBestMs(int iterations, F&& f)
+{
+    double best = 1e300;
+    for(int i = 0; i < iterations; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        f();
+        auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, milli>(stop - start).count());
+    }
+    return best;
+}
+
+// Function to generate a syntactically valid ToyC program of roughly the given size
+string makeSyntheticSource(size_t bytes)
+{
+    string out;
+    out.reserve(bytes + 512);
+    for(int n = 0; out.size() < bytes; n++)
+    {
+        string name = "f" + to_string(n);
+        string callee = "f" + to_string(n > 0 ? n - 1 : 0);
+        out += "int " + name + "(int a, int b) {\n";
+        out += "    int result = 0, i = a;\n";
+        out += "    /* accumulate a small polynomial */\n";
+        out += "    while (i > 0 && b != 0) i = i - 1;\n";
+        out += "    if (a % 2 == 0 || b < 10) result = result + a * b - 3; else result = result - (a / 2);\n";
+        out += "    " + callee + "(result, -b);\n";
+        out += "    return result + " + callee + "(a - 1, b) * 2; // tail\n";
+        out += "}\n";
+    }
+    return out;
+}
+
+volatile size_t benchSink; // 累加分析结果，防止被测代码被优化掉
+
+void printBenchRow(const char* name, double ms, size_t bytes, size_t tokens)
+{
+    printf("  %-34s %9.2f ms %9.1f MB/s %8.1f Mtok/s\n",
+           name, ms, bytes / 1e6 / (ms / 1e3), tokens / 1e6 / (ms / 1e3));
+}
+
+// 按语句和表达式递归地数二元运算节点，与 AstPrinter 一样经由 DeepStack 换栈，语法分析接受的嵌套深度这里都走得下去
+size_t countBinaryNodes(DeepStack& deepStack, const Expr* expr);
+size_t countBinaryNodes(DeepStack& deepStack, const Stmt* stmt);
+
+size_t countBinaryNodesBody(DeepStack& deepStack, const Expr* expr)
+{
+    if(expr == nullptr)
+        return 0;
+    switch(expr->kind)
+    {
+        case ExprKind::CALL:
+        {
+            size_t n = 0;
+            for(const Expr* arg : static_cast<const CallExpr*>(expr)->args)
+                n += countBinaryNodes(deepStack, arg);
+            return n;
+        }
+        case ExprKind::UNARY:
+            return countBinaryNodes(deepStack, static_cast<const UnaryExpr*>(expr)->operand);
+        case ExprKind::BINARY:
+        {
+            const BinaryExpr* binary = static_cast<const BinaryExpr*>(expr);
+            return 1 + countBinaryNodes(deepStack, binary->lhs) + countBinaryNodes(deepStack, binary->rhs);
+        }
+        default:
+            return 0;
+    }
+}
+
+size_t countBinaryNodesBody(DeepStack& deepStack, const Stmt* stmt)
+{
+    if(stmt == nullptr)
+        return 0;
+    switch(stmt->kind)
+    {
+        case StmtKind::BLOCK:
+        {
+            size_t n = 0;
+            for(const Stmt* s : static_cast<const BlockStmt*>(stmt)->stmts)
+                n += countBinaryNodes(deepStack, s);
+            return n;
+        }
+        case StmtKind::EXPR: return countBinaryNodes(deepStack, static_cast<const ExprStmt*>(stmt)->expr);
+        case StmtKind::ASSIGN: return countBinaryNodes(deepStack, static_cast<const AssignStmt*>(stmt)->value);
+        case StmtKind::RETURN: return countBinaryNodes(deepStack, static_cast<const ReturnStmt*>(stmt)->value);
+        case StmtKind::DECL:
+        {
+            size_t n = 0;
+            for(const VarDecl* var : static_cast<const DeclStmt*>(stmt)->vars)
+                n += countBinaryNodes(deepStack, var->init);
+            return n;
+        }
+        case StmtKind::IF:
+        {
+            const IfStmt* s = static_cast<const IfStmt*>(stmt);
+            return countBinaryNodes(deepStack, s->cond) + countBinaryNodes(deepStack, s->thenStmt)
+                   + countBinaryNodes(deepStack, s->elseStmt);
+        }
+        case StmtKind::WHILE:
+        {
+            const WhileStmt* s = static_cast<const WhileStmt*>(stmt);
+            return countBinaryNodes(deepStack, s->cond) + countBinaryNodes(deepStack, s->body);
+        }
+        default:
+            return 0;
+    }
+}
+
+size_t countBinaryNodes(DeepStack& deepStack, const Expr* expr)
+{
+    return deepStack.recurse([&] { return countBinaryNodesBody(deepStack, expr); });
+}
+
+size_t countBinaryNodes(DeepStack& deepStack, const Stmt* stmt)
+{
+    return deepStack.recurse([&] { return countBinaryNodesBody(deepStack, stmt); });
+}
+
+size_t countBinaryNodes(const CompUnit* unit)
+{
+    DeepStack deepStack;
+    size_t n = 0;
+    if(unit != nullptr)
+    {
+        for(const FuncDef* func : unit->funcs)
+            n += countBinaryNodes(deepStack, func->body);
+    }
+    return n;
+}
+
+void benchSource(const string& name, string_view source, int iterations, unsigned threads)
+{
+    vector<Token> tokens = LexicalAnalyzer(source).tokenize();
+    TokenBuffer buffer;
+    LexicalAnalyzer(source).tokenize(buffer);
+    size_t count = tokens.size();
+
+    printf("%s: %zu bytes, %zu tokens, %d iterations (best)\n", name.c_str(), source.size(), count, iterations);
+    printf("  token storage: vector<Token> %zu bytes, TokenBuffer %zu bytes\n",
+           count * sizeof(Token), buffer.memoryUsage());
+
+    printBenchRow("lex -> vector<Token>", benchBestMs(iterations, [&] {
+        benchSink += LexicalAnalyzer(source).tokenize().size();
+    }), source.size(), count);
+    printBenchRow(("lex -> vector<Token>, " + to_string(threads) + " threads").c_str(), benchBestMs(iterations, [&] {
+        benchSink += tokenizeInParallel(source, threads).size();
+    }), source.size(), count);
+    printBenchRow("lex -> TokenBuffer", benchBestMs(iterations, [&] {
+        TokenBuffer out;
+        LexicalAnalyzer(source).tokenize(out);
+        benchSink += out.size();
+    }), source.size(), count);
+    printBenchRow("parse vector<Token>", benchBestMs(iterations, [&] {
+        SyntaxAnalyzer parser(tokens, source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("parse TokenBuffer", benchBestMs(iterations, [&] {
+        SoASyntaxAnalyzer parser(buffer, source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("signatures TokenBuffer", benchBestMs(iterations, [&] {
+        SoASyntaxAnalyzer parser(buffer, source);
+        parser.parseSignatures();
+        benchSink += parser.getSignatures().size();
+    }), source.size(), count);
+    printBenchRow("signatures+bodies TokenBuffer", benchBestMs(iterations, [&] {
+        SoASyntaxAnalyzer parser(buffer, source);
+        parser.parseSignatures();
+        benchSink += parser.parseBodies();
+    }), source.size(), count);
+    printBenchRow(("parse vector<Token>, " + to_string(threads) + " threads").c_str(), benchBestMs(iterations, [&] {
+        benchSink += parseInParallel(tokens, source, threads).size();
+    }), source.size(), count);
+    printBenchRow("parse+semantic check vector<Token>", benchBestMs(iterations, [&] {
+        Interner interner;
+        SemanticChecker checker(source, interner);
+        SyntaxAnalyzer parser(tokens, source);
+        parser.checkSemantics(checker);
+        benchSink += parser.parse() + checker.getDiagnostics().size();
+    }), source.size(), count);
+    // 词法分析时已驻留的 TokenBuffer：检查直接用带过来的符号 ID，不再按名字查表
+    Interner lexerInterner;
+    TokenBuffer internedBuffer;
+    LexicalAnalyzer internedLexer(source);
+    internedLexer.internInto(lexerInterner);
+    internedLexer.tokenize(internedBuffer);
+    printBenchRow("parse+semantic check lexer IDs", benchBestMs(iterations, [&] {
+        SemanticChecker checker(source, lexerInterner);
+        SoASyntaxAnalyzer parser(internedBuffer, source);
+        parser.checkSemantics(checker);
+        benchSink += parser.parse() + checker.getDiagnostics().size();
+    }), source.size(), count);
+    printBenchRow("parse+AST vector<Token>", benchBestMs(iterations, [&] {
+        AstArena arena;
+        BasicSyntaxAnalyzer<TokenStream, ArenaAstBuilder> parser(tokens, source, ArenaAstBuilder(arena));
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("parse+flat AST vector<Token>", benchBestMs(iterations, [&] {
+        FlatAst flat;
+        BasicSyntaxAnalyzer<TokenStream, FlatAstBuilder> parser(tokens, source, FlatAstBuilder(flat));
+        benchSink += parser.parse();
+    }), source.size(), count);
+
+    // 两种语法树各建一份，比较内存和遍历一遍（数二元运算节点）的时间
+    AstArena arena;
+    BasicSyntaxAnalyzer<TokenStream, ArenaAstBuilder> treeParser(tokens, source, ArenaAstBuilder(arena));
+    treeParser.parse();
+    CompUnit* unit = treeParser.getAst();
+    FlatAst flat;
+    BasicSyntaxAnalyzer<TokenStream, FlatAstBuilder> flatParser(tokens, source, FlatAstBuilder(flat));
+    flatParser.parse();
+    printBenchRow("walk pointer AST", benchBestMs(iterations, [&] {
+        benchSink += countBinaryNodes(unit);
+    }), source.size(), count);
+    printBenchRow("lower to IR pointer AST", benchBestMs(iterations, [&] {
+        Interner interner;
+        IrGenerator generator(source, interner);
+        benchSink += generator.generate(unit).functions.size();
+    }), source.size(), count);
+    printBenchRow("scan flat AST", benchBestMs(iterations, [&] {
+        size_t binaries = 0;
+        for(const FlatNode& node : flat)
+            binaries += node.tag == FlatTag::BINARY;
+        benchSink += binaries;
+    }), source.size(), count);
+    printBenchRow("lex+parse vector<Token>", benchBestMs(iterations, [&] {
+        SyntaxAnalyzer parser(LexicalAnalyzer(source).tokenize(), source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("lex+parse TokenBuffer", benchBestMs(iterations, [&] {
+        TokenBuffer out;
+        LexicalAnalyzer(source).tokenize(out);
+        SoASyntaxAnalyzer parser(out, source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("lex+parse streaming", benchBestMs(iterations, [&] {
+        LexicalAnalyzer lexer(source);
+        SyntaxAnalyzer parser(lexer, source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+    printBenchRow("lex+parse pipeline", benchBestMs(iterations, [&] {
+        TokenPipeline pipeline(source);
+        PipelineSyntaxAnalyzer parser(pipeline, source);
+        benchSink += parser.parse();
+    }), source.size(), count);
+
+    // 缓存文件写到临时目录，测的是“命中缓存”这条路径：校验 + mmap + 解析
+    string cachePath = "/tmp/syntax-bench-" + to_string(getpid()) + ".tok";
+    if(TokenCache::write(cachePath.c_str(), buffer, source))
+    {
+        printBenchRow("map+parse token cache", benchBestMs(iterations, [&] {
+            TokenCache cache;
+            if(cache.open(cachePath.c_str(), source))
+            {
+                CachedSyntaxAnalyzer parser(cache, source);
+                benchSink += parser.parse();
+            }
+        }), source.size(), count);
+        remove(cachePath.c_str());
+    }
+
+    printBenchRow("intern identifiers", benchBestMs(iterations, [&] {
+        Interner interner;
+        benchSink += internIdentifiers(tokens, source, interner).size();
+    }), source.size(), count);
+    printBenchRow(("intern identifiers, " + to_string(threads) + " threads").c_str(), benchBestMs(iterations, [&] {
+        ConcurrentInterner interner;
+        benchSink += internIdentifiersInParallel(tokens, source, interner, threads).size();
+    }), source.size(), count);
+    printBenchRow("lex+intern -> TokenBuffer", benchBestMs(iterations, [&] {
+        Interner interner;
+        LexicalAnalyzer lexer(source);
+        lexer.internInto(interner);
+        TokenBuffer out;
+        lexer.tokenize(out);
+        benchSink += out.size();
+    }), source.size(), count);
+
+    // 只统计 parse() 本身，cursor 的构造（流式窗口）不算在内
+    auto parseAllocations = [&](auto& parser) {
+        size_t before = benchAllocations.load();
+        benchSink += parser.parse();
+        return benchAllocations.load() - before;
+    };
+    SyntaxAnalyzer vectorParser(tokens, source);
+    SoASyntaxAnalyzer bufferParser(buffer, source);
+    LexicalAnalyzer lexer(source);
+    SyntaxAnalyzer streamParser(lexer, source);
+    size_t vectorAllocs = parseAllocations(vectorParser);
+    size_t bufferAllocs = parseAllocations(bufferParser);
+    size_t streamAllocs = parseAllocations(streamParser);
+    printf("  parse allocations: vector<Token> %zu, TokenBuffer %zu, streaming %zu\n",
+           vectorAllocs, bufferAllocs, streamAllocs);
+    const ExprCallCounts& exprCalls = vectorParser.getExprCalls();
+    double operands = double(max<size_t>(exprCalls.operands, 1));
+    printf("  expression calls: precedence climbing %zu (%.2f per operand), recursive descent %zu (%.2f per operand)\n",
+           exprCalls.calls, exprCalls.calls / operands, exprCalls.descent, exprCalls.descent / operands);
+    printf("  AST: pointer nodes %zu bytes, flat nodes %zu bytes (%u nodes)\n",
+           arena.bytesUsed(), flat.bytesUsed(), flat.size());
+    Interner interner;
+    internIdentifiers(tokens, source, interner);
+    InternerStats stats = interner.stats();
+    printf("  identifiers: %zu occurrences, %zu unique, names %zu bytes, tables %zu bytes\n",
+           stats.occurrences, stats.unique, stats.nameBytes, stats.tableBytes);
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 5;
+    vector<string> files;
+    size_t syntheticBytes = 0;
+    unsigned threads = max(2u, thread::hardware_concurrency());
+    for(int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if(arg == "--iterations" && i + 1 < argc)
+            iterations = max(1, atoi(argv[++i]));
+        else if(arg == "--synthetic" && i + 1 < argc)
+            syntheticBytes = size_t(atof(argv[++i]) * 1e6);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = unsigned(max(1, atoi(argv[++i])));
+        else
+            files.push_back(arg);
+    }
+    if(files.empty() && syntheticBytes == 0)
+        syntheticBytes = 20 * 1000 * 1000;
+
+    for(const string& file : files)
+    {
+        SourceBuffer source;
+        if(!source.open(file.c_str()))
+        {
+            cerr << "cannot read " << file << endl;
+            return 1;
+        }
+        source.ensureTrailingNewline();
+        benchSource(file, source.view(), iterations, threads);
+    }
+    if(syntheticBytes > 0)
+    {
+        string source = makeSyntheticSource(syntheticBytes);
+        benchSource("synthetic", source, iterations, threads);
+    }
+    return 0;
+}
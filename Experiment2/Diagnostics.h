@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../Common/LineIndex.h"
+#include "../Common/TokenKind.h"
+#include "Ast.h"
+
+// 诊断信息：分析时只往 vector 末尾追加定长的记录（错误码、字节范围、期望的 token 集合），
+// 不查行号也不拼字符串；分析完后排一次序、去一次重，再输出成原来的 "reject" + 行号，
+// 或者带源码摘录的完整消息，行号、列号和摘录只为真正输出的那些错误计算。
+
+enum class DiagnosticCode : uint8_t {
+    // 语法错误，expected 是期望的 token 集合
+    EXPECTED_TOKEN,       // 需要 expected 中的某个 token
+    EXPECTED_STATEMENT,   // 这里应当是一条语句
+    EXPECTED_EXPRESSION,  // 这里应当是一个表达式
+    // 语义错误（SemanticChecker），范围是出错的名字或关键字
+    UNDECLARED_VARIABLE,  // 使用或赋值了没有声明的变量
+    REDECLARED_VARIABLE,  // 同一个作用域里重复声明
+    UNKNOWN_FUNCTION,     // 调用了没有定义的函数
+    REDEFINED_FUNCTION,   // 同名的函数定义了不止一次
+    JUMP_OUTSIDE_LOOP,    // while 之外的 break / continue
+    MISSING_RETURN,       // int 函数可能不经 return 执行到末尾
+    RETURN_WITHOUT_VALUE, // int 函数里的 return;
+    VOID_RETURNS_VALUE,   // void 函数里的 return Expr;
+    ARGUMENT_COUNT,       // 实参个数与形参个数不同，expected 是形参个数
+};
+
+// Function to get the bit of a token kind in an expected-token set
+constexpr uint64_t tokenBit(TokenKind kind)
+{
+    return uint64_t(1) << unsigned(kind);
+}
+
+static_assert(unsigned(TokenKind::END_OF_FILE) < 64, "expected-token sets are 64-bit masks");
+
+// Function to get how a token kind is written in a message
+inline const char* tokenKindSpelling(TokenKind kind)
+{
+    switch(kind)
+    {
+        case TokenKind::IDENTIFIER:      return "identifier";
+        case TokenKind::INTEGER_LITERAL: return "integer constant";
+        case TokenKind::KW_INT:          return "'int'";
+        case TokenKind::KW_IF:           return "'if'";
+        case TokenKind::KW_ELSE:         return "'else'";
+        case TokenKind::KW_WHILE:        return "'while'";
+        case TokenKind::KW_BREAK:        return "'break'";
+        case TokenKind::KW_CONTINUE:     return "'continue'";
+        case TokenKind::KW_RETURN:       return "'return'";
+        case TokenKind::KW_VOID:         return "'void'";
+        case TokenKind::OP_PLUS:         return "'+'";
+        case TokenKind::OP_MINUS:        return "'-'";
+        case TokenKind::OP_MUL:          return "'*'";
+        case TokenKind::OP_DIV:          return "'/'";
+        case TokenKind::OP_MOD:          return "'%'";
+        case TokenKind::OP_LT:           return "'<'";
+        case TokenKind::OP_LE:           return "'<='";
+        case TokenKind::OP_GT:           return "'>'";
+        case TokenKind::OP_GE:           return "'>='";
+        case TokenKind::OP_EQ:           return "'=='";
+        case TokenKind::OP_NE:           return "'!='";
+        case TokenKind::OP_AND:          return "'&&'";
+        case TokenKind::OP_OR:           return "'||'";
+        case TokenKind::OP_NOT:          return "'!'";
+        case TokenKind::OP_ASSIGN:       return "'='";
+        case TokenKind::OP_AMP:          return "'&'";
+        case TokenKind::OP_PIPE:         return "'|'";
+        case TokenKind::P_LPAREN:        return "'('";
+        case TokenKind::P_RPAREN:        return "')'";
+        case TokenKind::P_LBRACE:        return "'{'";
+        case TokenKind::P_RBRACE:        return "'}'";
+        case TokenKind::P_SEMI:          return "';'";
+        case TokenKind::P_COMMA:         return "','";
+        case TokenKind::UNKNOWN:         return "unknown token";
+        case TokenKind::END_OF_FILE:     return "end of input";
+    }
+    return "?";
+}
+
+// Struct to represent one diagnostic, 24 bytes
+struct Diagnostic {
+    uint32_t offset;   // 出错的 token 或名字在源码中的位置
+    uint32_t length;
+    uint64_t expected; // 语法错误时是按 tokenBit() 置位的 token 集合，ARGUMENT_COUNT 时是形参个数
+    DiagnosticCode code;
+};
+
+// Class that collects diagnostics during analysis and renders them afterwards
+class Diagnostics {
+private:
+    std::vector<Diagnostic> records;
+    size_t limit;        // 最多报告多少个出错位置，0 表示不限
+    size_t positions;    // 追加过的不同出错位置个数；顺序分析时位置只增不减，和上一条比较就够了
+    size_t reports;      // report() 被调用的次数，包括丢掉的重复记录
+    uint32_t lastOffset;
+
+    static bool identical(const Diagnostic& a, const Diagnostic& b)
+    {
+        return a.offset == b.offset && a.length == b.length && a.expected == b.expected && a.code == b.code;
+    }
+
+    static bool isSyntaxError(DiagnosticCode code)
+    {
+        return code <= DiagnosticCode::EXPECTED_EXPRESSION;
+    }
+
+    // Function to write the token at a syntax error, “before 'x'” or “at end of input”
+    static void writeFound(std::ostream& out, const Diagnostic& record, std::string_view source)
+    {
+        const size_t MAX_SHOWN = 32;
+        if(record.length == 0)
+        {
+            out << " at end of input";
+            return;
+        }
+        std::string_view text = source.substr(record.offset, std::min<size_t>(record.length, MAX_SHOWN));
+        out << " before '" << text << (record.length > MAX_SHOWN ? "...'" : "'");
+    }
+
+    static void writeExpected(std::ostream& out, uint64_t expected)
+    {
+        bool first = true;
+        for(unsigned kind = 0; kind <= unsigned(TokenKind::END_OF_FILE); kind++)
+        {
+            if((expected & tokenBit(TokenKind(kind))) == 0)
+                continue;
+            out << (first ? "" : " or ") << tokenKindSpelling(TokenKind(kind));
+            first = false;
+        }
+    }
+
+    static void writeMessage(std::ostream& out, const Diagnostic& record, std::string_view source)
+    {
+        std::string_view name = source.substr(record.offset, record.length);
+        switch(record.code)
+        {
+            case DiagnosticCode::EXPECTED_TOKEN:
+                out << "expected ";
+                writeExpected(out, record.expected);
+                writeFound(out, record, source);
+                return;
+            case DiagnosticCode::EXPECTED_STATEMENT:
+                out << "expected a statement";
+                writeFound(out, record, source);
+                return;
+            case DiagnosticCode::EXPECTED_EXPRESSION:
+                out << "expected an expression";
+                writeFound(out, record, source);
+                return;
+            case DiagnosticCode::UNDECLARED_VARIABLE:
+                out << "'" << name << "' was not declared";
+                return;
+            case DiagnosticCode::REDECLARED_VARIABLE:
+                out << "redeclaration of '" << name << "'";
+                return;
+            case DiagnosticCode::UNKNOWN_FUNCTION:
+                out << "call to undefined function '" << name << "'";
+                return;
+            case DiagnosticCode::REDEFINED_FUNCTION:
+                out << "redefinition of function '" << name << "'";
+                return;
+            case DiagnosticCode::JUMP_OUTSIDE_LOOP:
+                out << "'" << name << "' outside a while loop";
+                return;
+            case DiagnosticCode::MISSING_RETURN:
+                out << "int function '" << name << "' can reach its end without returning a value";
+                return;
+            case DiagnosticCode::RETURN_WITHOUT_VALUE:
+                out << "return without a value in an int function";
+                return;
+            case DiagnosticCode::VOID_RETURNS_VALUE:
+                out << "return with a value in a void function";
+                return;
+            case DiagnosticCode::ARGUMENT_COUNT:
+                out << "'" << name << "' takes " << record.expected
+                    << (record.expected == 1 ? " argument" : " arguments");
+                return;
+        }
+    }
+
+public:
+    // 不设 limit 时也只接收这么多次报告：输入里的错误多到这个次数，或者错误恢复万一原地打转一直报同一个错误，
+    // 分析器都在这里停下，而不是让记录无限地增长下去；驱动程序会提示输出被截断了
+    static constexpr size_t MAX_REPORTS = size_t(1) << 22;
+
+    explicit Diagnostics(size_t maxErrors = 0)
+        : limit(maxErrors)
+        , positions(0)
+        , reports(0)
+        , lastOffset(0)
+    {}
+
+    // Function to stop accepting diagnostics after maxErrors error positions, 0 for no limit
+    void setLimit(size_t maxErrors) { limit = maxErrors; }
+
+    // Function to append a record, false once the limit of error positions or MAX_REPORTS has been reached
+    // 与上一条完全相同的记录不再追加，原地打转时记录不会越积越多
+    bool report(const Diagnostic& record)
+    {
+        if(full())
+            return false;
+        reports++;
+        if(!records.empty() && identical(records.back(), record))
+            return !full();
+        if(records.empty() || record.offset != lastOffset)
+            positions++;
+        lastOffset = record.offset;
+        records.push_back(record);
+        return !full();
+    }
+
+    bool report(DiagnosticCode code, SourceSpan span, uint64_t expected = 0)
+    {
+        return report(Diagnostic{span.offset, span.length, expected, code});
+    }
+
+    bool full() const { return (limit != 0 && positions >= limit) || reports >= MAX_REPORTS; }
+
+    // Function to tell whether appending other would make this full, so the analysis would have stopped inside it
+    bool fillsUp(const Diagnostics& other) const
+    {
+        return (limit != 0 && positions + other.positions >= limit) || reports + other.reports >= MAX_REPORTS;
+    }
+
+    // Function to append every record of other, e.g. from another slice of the same source
+    void append(const Diagnostics& other)
+    {
+        records.insert(records.end(), other.records.begin(), other.records.end());
+        positions += other.positions;
+        reports += other.reports;
+    }
+
+    void clear()
+    {
+        records.clear();
+        positions = 0;
+        reports = 0;
+    }
+
+    // Function to sort the records by position and drop duplicates, once after analysis
+    // 同一位置、同一错误码的记录合并成一条，期望的 token 集合取并集；有上限时只留前 limit 个位置
+    void finish()
+    {
+        std::stable_sort(records.begin(), records.end(), [](const Diagnostic& a, const Diagnostic& b) {
+            return a.offset != b.offset ? a.offset < b.offset : a.code < b.code;
+        });
+        size_t out = 0;
+        size_t kept = 0;
+        for(size_t i = 0; i < records.size(); i++)
+        {
+            const Diagnostic& record = records[i];
+            if(out > 0 && records[out - 1].offset == record.offset && records[out - 1].code == record.code)
+            {
+                if(isSyntaxError(record.code))
+                    records[out - 1].expected |= record.expected;
+                continue;
+            }
+            if(out == 0 || records[out - 1].offset != record.offset)
+            {
+                if(limit != 0 && kept == limit)
+                    break;
+                kept++;
+            }
+            records[out++] = record;
+        }
+        records.resize(out);
+        positions = kept;
+    }
+
+    bool empty() const { return records.empty(); }
+    size_t size() const { return records.size(); }
+    const Diagnostic* begin() const { return records.data(); }
+    const Diagnostic* end() const { return records.data() + records.size(); }
+
+    // Function to print “reject” and the distinct error lines, the original output format
+    void renderLines(std::ostream& out, LineIndex& lines) const
+    {
+        out << "reject\n";
+        int last = 0;
+        for(const Diagnostic& record : records)
+        {
+            int line = lines.lineOf(record.offset);
+            if(line != last)
+                out << line << '\n';
+            last = line;
+        }
+        out.flush();
+    }
+
+    // Function to print “reject” and one message with a source excerpt per diagnostic
+    //   name:3:14: error: expected ';' before 'x'
+    //       3 | int a = 1 x
+    //         |           ^~
+    void renderMessages(std::ostream& out, std::string_view name, std::string_view source, LineIndex& lines) const
+    {
+        out << "reject\n";
+        for(const Diagnostic& record : records)
+        {
+            int line = lines.lineOf(record.offset);
+            int column = lines.columnOf(record.offset);
+            out << name << ':' << line << ':' << column << ": error: ";
+            writeMessage(out, record, source);
+            out << '\n';
+
+            size_t lineStart = record.offset - uint32_t(column - 1);
+            size_t lineEnd = source.find('\n', lineStart);
+            if(lineEnd == std::string_view::npos)
+                lineEnd = source.size();
+            std::string_view excerpt = source.substr(lineStart, lineEnd - lineStart);
+            if(!excerpt.empty() && excerpt.back() == '\r')
+                excerpt.remove_suffix(1);
+            char number[16];
+            int width = std::snprintf(number, sizeof(number), "%5d", line);
+            out << number << " | " << excerpt << '\n';
+            out << std::string(size_t(width), ' ') << " | ";
+            for(size_t i = lineStart; i < record.offset; i++)
+                out << (source[i] == '\t' ? '\t' : ' '); // 制表符原样保留，插入符才能对齐
+            out << '^';
+            size_t underline = std::min<size_t>(record.length, lineEnd - record.offset);
+            if(underline > 1)
+                out << std::string(underline - 1, '~');
+            out << '\n';
+        }
+        out.flush();
+    }
+};
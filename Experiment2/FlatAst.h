@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+#include "../Common/Scan.h"
+#include "../Common/TokenKind.h"
+#include "Ast.h"
+
+// 扁平语法树：所有节点是同一个数组里 8 字节的定长记录，子节点用 32 位下标引用，
+// 变长的部分（参数表、语句表、if 的三个分支）放在 extra 数组里。
+// 节点按后序追加：子树总是在父节点之前，线性扫描就是一次自底向上的遍历；
+// 最后一个子节点总是紧挨在父节点前面（下标 i - 1），所以二元运算只需要记 lhs。
+// 下标 0 是占位的 NONE，表示“没有”；出错的位置是 ERROR 节点，不会留空。
+//
+//   tag          aux              data                        隐含的子节点 (i - 1)
+//   ERROR        -                出错 token 的偏移
+//   INT_LITERAL  -                token 偏移
+//   NAME         -                token 偏移
+//   CALL         -                extra: callee 偏移, n, 实参 * n
+//   UNARY        运算符 TokenKind  运算符偏移                  操作数
+//   BINARY       运算符 TokenKind  lhs 下标                    rhs
+//   BLOCK        -                extra: n, 语句 * n
+//   EXPR_STMT    -                语句开头偏移                  表达式
+//   ASSIGN       -                变量名偏移                    右值
+//   VAR_DECL     有初值为 1        变量名偏移                    初值（aux 为 1 时）
+//   DECL         -                extra: n, VAR_DECL * n
+//   IF           -                extra: cond, then, else（没有 else 为 0）
+//   WHILE        -                cond 下标                     循环体
+//   BREAK        -                token 偏移
+//   CONTINUE     -                token 偏移
+//   RETURN       有返回值为 1      return 的偏移                 返回值（aux 为 1 时）
+//   PARAM        -                形参名偏移
+//   FUNC_DEF     返回类型 TokenKind extra: 函数名偏移, n, PARAM * n  函数体
+//   COMP_UNIT    -                extra: n, FUNC_DEF * n
+
+enum class FlatTag : uint8_t {
+    NONE,
+    ERROR,
+    INT_LITERAL,
+    NAME,
+    CALL,
+    UNARY,
+    BINARY,
+    BLOCK,
+    EXPR_STMT,
+    ASSIGN,
+    VAR_DECL,
+    DECL,
+    IF,
+    WHILE,
+    BREAK,
+    CONTINUE,
+    RETURN,
+    PARAM,
+    FUNC_DEF,
+    COMP_UNIT,
+};
+
+struct FlatNode {
+    FlatTag tag;
+    uint8_t aux;
+    uint16_t reserved; // 保持为 0，写盘时没有未初始化的字节
+    uint32_t data;
+
+    TokenKind op() const { return TokenKind(aux); }
+};
+
+static_assert(sizeof(FlatNode) == 8, "FlatNode is meant to stay an 8-byte record");
+
+// Struct to represent the header written in front of the two arrays
+struct FlatAstHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t extraCount;
+};
+
+class FlatAst {
+private:
+    std::vector<FlatNode> nodes;
+    std::vector<uint32_t> extra;
+
+public:
+    static const uint32_t MAGIC = 0x54534146; // "FAST"
+    static const uint32_t VERSION = 1;
+
+    FlatAst()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        nodes.assign(1, FlatNode{FlatTag::NONE, 0, 0, 0});
+        extra.clear();
+    }
+
+    uint32_t add(FlatTag tag, uint8_t aux, uint32_t data)
+    {
+        nodes.push_back(FlatNode{tag, aux, 0, data});
+        return uint32_t(nodes.size() - 1);
+    }
+
+    // Function to append a run of extra operands, returns the index of the first one
+    uint32_t addExtra(const uint32_t* items, size_t count)
+    {
+        uint32_t index = uint32_t(extra.size());
+        extra.insert(extra.end(), items, items + count);
+        return index;
+    }
+
+    uint32_t size() const { return uint32_t(nodes.size()); }
+    const FlatNode& node(uint32_t i) const { return nodes[i]; }
+    const FlatNode* begin() const { return nodes.data(); }
+    const FlatNode* end() const { return nodes.data() + nodes.size(); }
+    const uint32_t* extraAt(uint32_t index) const { return extra.data() + index; }
+
+    // 整棵树的根是最后一个节点（COMP_UNIT）
+    uint32_t root() const { return uint32_t(nodes.size() - 1); }
+
+    size_t bytesUsed() const
+    {
+        return nodes.size() * sizeof(FlatNode) + extra.size() * sizeof(uint32_t);
+    }
+
+    // Function to get the text of the token a leaf points at
+    // 节点只记录偏移，标识符和整数的长度重新扫一遍得到
+    static std::string_view tokenText(std::string_view source, uint32_t offset)
+    {
+        const char* p = source.data() + offset;
+        const char* end = source.data() + source.size();
+        const char* stop = p;
+        if(stop < end && (charClassOf(*stop) & CHAR_DIGIT))
+        {
+            while(stop < end && (charClassOf(*stop) & CHAR_DIGIT))
+                stop++;
+        }
+        else
+            stop = scanIdentifierEnd(p, end);
+        return std::string_view(p, size_t(stop - p));
+    }
+
+    // Function to write the header and both arrays with a single writev call
+    // 只有在内核写了一部分时才会继续补写剩下的字节
+    bool writeTo(int fd) const
+    {
+        FlatAstHeader header{MAGIC, VERSION, uint32_t(nodes.size()), uint32_t(extra.size())};
+        iovec parts[3] = {
+            {&header, sizeof(header)},
+            {const_cast<FlatNode*>(nodes.data()), nodes.size() * sizeof(FlatNode)},
+            {const_cast<uint32_t*>(extra.data()), extra.size() * sizeof(uint32_t)},
+        };
+        iovec* iov = parts;
+        int count = 3;
+        while(count > 0)
+        {
+            ssize_t n = ::writev(fd, iov, count);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                return false;
+            }
+            size_t written = size_t(n);
+            while(count > 0 && written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if(count > 0)
+            {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+        return true;
+    }
+};
+
+// Class that builds a FlatAst for BasicSyntaxAnalyzer
+// 扁平语法树要写进文件，符号 ID 只在本次驻留表里有意义，所以不记
+class FlatAstBuilder {
+private:
+    FlatAst* ast;
+    std::vector<uint32_t> scratch; // 正在构造的列表，嵌套的列表共用这一个栈
+
+    // Function to move the list collected since mark into extra, prefixed with head
+    uint32_t finish(size_t mark, const uint32_t* head, size_t headCount)
+    {
+        uint32_t index = ast->addExtra(head, headCount);
+        uint32_t count = uint32_t(scratch.size() - mark);
+        ast->addExtra(&count, 1);
+        ast->addExtra(scratch.data() + mark, count);
+        scratch.resize(mark);
+        return index;
+    }
+
+public:
+    static const bool BUILDS_TREE = true;
+    typedef uint32_t ExprRef;
+    typedef uint32_t StmtRef;
+    typedef uint32_t VarRef;
+    typedef uint32_t ParamRef;
+    typedef uint32_t FuncRef;
+    typedef uint32_t UnitRef;
+
+    explicit FlatAstBuilder(FlatAst& tree)
+        : ast(&tree)
+    {}
+
+    size_t mark() const { return scratch.size(); }
+    void push(uint32_t item) { scratch.push_back(item); }
+
+    uint32_t noExpr() { return 0; }
+    uint32_t noStmt() { return 0; }
+    uint32_t errorExpr(SourceSpan at) { return ast->add(FlatTag::ERROR, 0, at.offset); }
+    uint32_t errorStmt(SourceSpan at) { return ast->add(FlatTag::ERROR, 0, at.offset); }
+    uint32_t errorVar(SourceSpan at) { return ast->add(FlatTag::ERROR, 0, at.offset); }
+    uint32_t errorParam(SourceSpan at) { return ast->add(FlatTag::ERROR, 0, at.offset); }
+    uint32_t errorFunc(SourceSpan at) { return ast->add(FlatTag::ERROR, 0, at.offset); }
+
+    uint32_t intLiteral(SourceSpan span) { return ast->add(FlatTag::INT_LITERAL, 0, span.offset); }
+    uint32_t name(SourceSpan span, uint32_t) { return ast->add(FlatTag::NAME, 0, span.offset); }
+
+    uint32_t call(SourceSpan, SourceSpan callee, uint32_t, size_t argMark)
+    {
+        return ast->add(FlatTag::CALL, 0, finish(argMark, &callee.offset, 1));
+    }
+
+    uint32_t unary(SourceSpan span, TokenKind op, uint32_t)
+    {
+        return ast->add(FlatTag::UNARY, uint8_t(op), span.offset);
+    }
+
+    uint32_t binary(SourceSpan, TokenKind op, uint32_t lhs, uint32_t)
+    {
+        return ast->add(FlatTag::BINARY, uint8_t(op), lhs);
+    }
+
+    uint32_t block(SourceSpan, size_t stmtMark)
+    {
+        return ast->add(FlatTag::BLOCK, 0, finish(stmtMark, nullptr, 0));
+    }
+
+    uint32_t exprStmt(SourceSpan span, uint32_t)
+    {
+        return ast->add(FlatTag::EXPR_STMT, 0, span.offset);
+    }
+
+    uint32_t assign(SourceSpan, SourceSpan name, uint32_t, uint32_t)
+    {
+        return ast->add(FlatTag::ASSIGN, 0, name.offset);
+    }
+
+    uint32_t varDecl(SourceSpan name, uint32_t, uint32_t init)
+    {
+        return ast->add(FlatTag::VAR_DECL, init != 0, name.offset);
+    }
+
+    uint32_t decl(SourceSpan, size_t varMark)
+    {
+        return ast->add(FlatTag::DECL, 0, finish(varMark, nullptr, 0));
+    }
+
+    uint32_t ifStmt(SourceSpan, uint32_t cond, uint32_t thenStmt, uint32_t elseStmt)
+    {
+        uint32_t parts[3] = {cond, thenStmt, elseStmt};
+        return ast->add(FlatTag::IF, 0, ast->addExtra(parts, 3));
+    }
+
+    uint32_t whileStmt(SourceSpan, uint32_t cond, uint32_t)
+    {
+        return ast->add(FlatTag::WHILE, 0, cond);
+    }
+
+    uint32_t breakStmt(SourceSpan span) { return ast->add(FlatTag::BREAK, 0, span.offset); }
+    uint32_t continueStmt(SourceSpan span) { return ast->add(FlatTag::CONTINUE, 0, span.offset); }
+
+    uint32_t returnStmt(SourceSpan span, uint32_t value)
+    {
+        return ast->add(FlatTag::RETURN, value != 0, span.offset);
+    }
+
+    uint32_t param(SourceSpan name, uint32_t) { return ast->add(FlatTag::PARAM, 0, name.offset); }
+
+    uint32_t funcDef(TokenKind returnType, SourceSpan name, uint32_t, size_t paramMark, uint32_t)
+    {
+        return ast->add(FlatTag::FUNC_DEF, uint8_t(returnType), finish(paramMark, &name.offset, 1));
+    }
+
+    uint32_t compUnit(size_t funcMark)
+    {
+        return ast->add(FlatTag::COMP_UNIT, 0, finish(funcMark, nullptr, 0));
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "../Common/Arena.h"
+#include "../Common/TokenKind.h"
+#include "Ast.h"
+
+// 三地址中间表示：每个函数是一组基本块，块里是顺序执行的指令，最后一条转移（跳转、条件分支或返回）单独存放。
+// 值放在虚拟寄存器里，寄存器个数不限、可以反复赋值（不是 SSA）：形参是 %0 .. %n-1，
+// 局部变量各占一个寄存器，表达式的中间结果用新的临时寄存器。
+// 调用写成若干条 ARG 再加一条 CALL，实参在所有实参都求完值之后才依次给出。
+// 一个函数的块和指令都分配在这个函数自己的 Arena 里，不再需要时整个函数一次释放
+
+static constexpr uint32_t IR_NONE = UINT32_MAX; // 没有结果寄存器、没有块
+
+enum class IrOperandKind : uint8_t {
+    NONE,     // 不存在，例如 void 函数的 ret
+    REG,      // 虚拟寄存器 %value
+    IMM,      // 整数常量 value
+    FUNCTION, // 模块里第 value 个函数，只作为 CALL 的被调用者
+};
+
+// Struct to represent an instruction operand, 8 bytes
+struct IrOperand {
+    IrOperandKind kind;
+    int32_t value;
+
+    static IrOperand none() { return IrOperand{IrOperandKind::NONE, 0}; }
+    static IrOperand reg(uint32_t r) { return IrOperand{IrOperandKind::REG, int32_t(r)}; }
+    static IrOperand imm(int32_t v) { return IrOperand{IrOperandKind::IMM, v}; }
+    static IrOperand function(uint32_t index) { return IrOperand{IrOperandKind::FUNCTION, int32_t(index)}; }
+};
+
+enum class IrOp : uint8_t {
+    COPY, // dst = a
+    NEG,  // dst = -a
+    NOT,  // dst = !a，结果是 0 或 1
+    ADD, SUB, MUL, DIV, MOD,  // dst = a op b
+    LT, LE, GT, GE, EQ, NE,   // dst = a op b，结果是 0 或 1
+    ARG,  // 下一条 CALL 的一个实参 a，按实参顺序出现
+    CALL, // dst = a(前面的 ARG)，b 是实参个数；不用返回值时 dst 为 IR_NONE
+};
+
+// Struct to represent one three-address instruction
+struct IrInst {
+    IrOp op;
+    uint32_t dst;
+    IrOperand a;
+    IrOperand b;
+};
+
+enum class IrTermKind : uint8_t {
+    JUMP,   // 转到 target[0]
+    BRANCH, // value 非 0 时转到 target[0]，否则转到 target[1]
+    RET,    // 返回 value，void 函数的 value 为 NONE
+};
+
+// Struct to represent the control transfer that ends a basic block
+struct IrTerminator {
+    IrTermKind kind;
+    IrOperand value;
+    uint32_t target[2];
+};
+
+struct IrBlock {
+    IrInst* insts; // 在函数的 Arena 里
+    uint32_t instCount;
+    IrTerminator term;
+};
+
+// Struct to represent one lowered FuncDef, blocks[0] is the entry
+struct IrFunction {
+    TokenKind returnType;
+    SourceSpan name;
+    uint32_t paramCount;
+    uint32_t regCount;
+    IrBlock* blocks; // 在 arena 里
+    uint32_t blockCount;
+    Arena arena;
+};
+
+// Struct to represent the functions of one CompUnit, in source order
+struct IrModule {
+    std::vector<std::unique_ptr<IrFunction>> functions;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// 以文本形式打印中间表示，供 --emit-ir 使用
+//   func int add(%0, %1) {
+//   bb0:
+//     %2 = add %0, %1
+//     ret %2
+//   }
+class IrPrinter {
+private:
+    std::ostream& out;
+    std::string_view source;
+    const IrModule* module;
+
+    void printOperand(IrOperand operand)
+    {
+        switch(operand.kind)
+        {
+            case IrOperandKind::NONE:
+                break;
+            case IrOperandKind::REG:
+                out << '%' << uint32_t(operand.value);
+                break;
+            case IrOperandKind::IMM:
+                out << operand.value;
+                break;
+            case IrOperandKind::FUNCTION:
+                if(uint32_t(operand.value) < module->functions.size())
+                    out << module->functions[uint32_t(operand.value)]->name.text(source);
+                else
+                    out << "<undefined>";
+                break;
+        }
+    }
+
+    void printInst(const IrInst& inst)
+    {
+        out << "  ";
+        if(inst.dst != IR_NONE)
+            out << '%' << inst.dst << " = ";
+        out << opName(inst.op) << ' ';
+        printOperand(inst.a);
+        if(inst.b.kind != IrOperandKind::NONE)
+        {
+            out << ", ";
+            printOperand(inst.b);
+        }
+        out << '\n';
+    }
+
+    void printTerminator(const IrTerminator& term)
+    {
+        switch(term.kind)
+        {
+            case IrTermKind::JUMP:
+                out << "  jmp bb" << term.target[0] << '\n';
+                return;
+            case IrTermKind::BRANCH:
+                out << "  br ";
+                printOperand(term.value);
+                out << ", bb" << term.target[0] << ", bb" << term.target[1] << '\n';
+                return;
+            case IrTermKind::RET:
+                out << "  ret";
+                if(term.value.kind != IrOperandKind::NONE)
+                {
+                    out << ' ';
+                    printOperand(term.value);
+                }
+                out << '\n';
+                return;
+        }
+    }
+
+public:
+    static const char* opName(IrOp op)
+    {
+        switch(op)
+        {
+            case IrOp::COPY: return "copy";
+            case IrOp::NEG:  return "neg";
+            case IrOp::NOT:  return "not";
+            case IrOp::ADD:  return "add";
+            case IrOp::SUB:  return "sub";
+            case IrOp::MUL:  return "mul";
+            case IrOp::DIV:  return "div";
+            case IrOp::MOD:  return "mod";
+            case IrOp::LT:   return "lt";
+            case IrOp::LE:   return "le";
+            case IrOp::GT:   return "gt";
+            case IrOp::GE:   return "ge";
+            case IrOp::EQ:   return "eq";
+            case IrOp::NE:   return "ne";
+            case IrOp::ARG:  return "arg";
+            case IrOp::CALL: return "call";
+        }
+        return "?";
+    }
+
+    IrPrinter(std::ostream& output, std::string_view text)
+        : out(output)
+        , source(text)
+        , module(nullptr)
+    {}
+
+    void print(const IrModule& ir)
+    {
+        module = &ir;
+        for(const std::unique_ptr<IrFunction>& func : ir.functions)
+        {
+            out << "func " << (func->returnType == TokenKind::KW_INT ? "int " : "void ")
+                << func->name.text(source) << '(';
+            for(uint32_t i = 0; i < func->paramCount; i++)
+                out << (i > 0 ? ", %" : "%") << i;
+            out << ") {\n";
+            for(uint32_t b = 0; b < func->blockCount; b++)
+            {
+                const IrBlock& block = func->blocks[b];
+                out << "bb" << b << ":\n";
+                for(uint32_t i = 0; i < block.instCount; i++)
+                    printInst(block.insts[i]);
+                printTerminator(block.term);
+            }
+            out << "}\n";
+        }
+        module = nullptr;
+    }
+};
@@ -0,0 +1,541 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "../Common/DeepStack.h"
+#include "../Common/Interner.h"
+#include "../Common/ScopedSymbolTable.h"
+#include "../Common/TokenKind.h"
+#include "Ast.h"
+#include "Ir.h"
+
+// 把语法树翻译成三地址中间表示（见 Ir.h），输入应当已经通过语法和语义检查。
+// 名字按 SemanticChecker 的作用域规则解析，每个局部变量对应一个虚拟寄存器，赋值直接写进它。
+// && 和 || 不求出两边的值，而是翻译成条件分支：在 if / while 的条件里直接跳到两个去向，
+// 要用它的值时再在两个去向里分别给结果寄存器赋 1 和 0。
+// 指令先按块追加到复用的缓冲区里，函数翻译完后让跳转越过只有一条 jmp 的空块，去掉到不了的块，按生成顺序重新编号，
+// 最后一次复制到这个函数大小正好的 Arena 里
+
+// Class that lowers a CompUnit to an IrModule
+class IrGenerator {
+private:
+    // Struct to represent a block under construction, its instructions are insts[begin, begin + count)
+    struct ScratchBlock {
+        uint32_t begin;
+        uint32_t count;
+        IrTerminator term;
+        uint32_t newIndex; // 去掉到不了的块以后的编号，IR_NONE 表示去掉
+    };
+
+    static constexpr uint32_t ON_PATH = IR_NONE - 1; // skipEmptyBlocks 正在走的空块，暂时借用 newIndex
+
+    struct Loop {
+        uint32_t continueTarget; // 条件所在的块
+        uint32_t breakTarget;
+    };
+
+    std::string_view source;
+    Interner& interner;
+    ScopedSymbolTable variables;     // 变量的值是它的寄存器
+    std::vector<uint32_t> functions; // 按符号 ID 下标：函数在 CompUnit 里的序号，IR_NONE 表示没有这个函数
+    DeepStack deepStack;             // 语法分析能接受的深度，这里同样要走得下去
+
+    // 正在翻译的函数，每个函数开始时清空，缓冲区的容量留给下一个函数
+    std::vector<ScratchBlock> blocks;
+    std::vector<uint32_t> order;     // 块开始生成的顺序
+    std::vector<IrInst> insts;
+    std::vector<IrOperand> args;     // 正在求值的各层调用的实参，嵌套的调用共用这一个栈
+    std::vector<Loop> loops;
+    std::vector<uint32_t> worklist;
+    std::vector<IrInst> finalInsts;
+    std::vector<IrBlock> finalBlocks;
+    uint32_t current;                // 正在生成的块，IR_NONE 表示上一块已经结束
+    uint32_t nextReg;
+
+    // 语法树里记着词法分析给的符号 ID 时直接用，否则按文字驻留
+    uint32_t symbolOf(SourceSpan name, uint32_t symbol)
+    {
+        return symbol != Interner::NONE ? symbol : interner.intern(name.text(source));
+    }
+
+    uint32_t newReg()
+    {
+        return nextReg++;
+    }
+
+    uint32_t newBlock()
+    {
+        blocks.push_back(ScratchBlock{0, 0, IrTerminator{IrTermKind::RET, IrOperand::none(), {IR_NONE, IR_NONE}}, IR_NONE});
+        return uint32_t(blocks.size() - 1);
+    }
+
+    // Function to continue in block, falling through from the current block if it has not ended
+    void startBlock(uint32_t block)
+    {
+        if(current != IR_NONE)
+            jump(block);
+        blocks[block].begin = uint32_t(insts.size());
+        order.push_back(block);
+        current = block;
+    }
+
+    // return、break 之后的语句到不了，仍然给它们一个块，函数结束时再去掉
+    void ensureBlock()
+    {
+        if(current == IR_NONE)
+            startBlock(newBlock());
+    }
+
+    void emit(IrOp op, uint32_t dst, IrOperand a, IrOperand b = IrOperand::none())
+    {
+        ensureBlock();
+        insts.push_back(IrInst{op, dst, a, b});
+    }
+
+    void terminate(const IrTerminator& term)
+    {
+        ensureBlock();
+        ScratchBlock& block = blocks[current];
+        block.count = uint32_t(insts.size()) - block.begin;
+        block.term = term;
+        current = IR_NONE;
+    }
+
+    void jump(uint32_t target)
+    {
+        terminate(IrTerminator{IrTermKind::JUMP, IrOperand::none(), {target, IR_NONE}});
+    }
+
+    // Function to end the current block with a jump to target, unless it has already ended
+    void jumpIfOpen(uint32_t target)
+    {
+        if(current != IR_NONE)
+            jump(target);
+    }
+
+    void branch(IrOperand cond, uint32_t ifTrue, uint32_t ifFalse)
+    {
+        if(cond.kind == IrOperandKind::IMM) // 条件是常量时只剩一个去向
+            jump(cond.value != 0 ? ifTrue : ifFalse);
+        else
+            terminate(IrTerminator{IrTermKind::BRANCH, cond, {ifTrue, ifFalse}});
+    }
+
+    void ret(IrOperand value)
+    {
+        terminate(IrTerminator{IrTermKind::RET, value, {IR_NONE, IR_NONE}});
+    }
+
+    // Function to get the register of a variable
+    // 没通过语义检查的输入里可能有未声明的变量，给它一个从未赋值的寄存器
+    uint32_t variableReg(SourceSpan name, uint32_t symbol)
+    {
+        uint32_t reg = variables.lookup(symbolOf(name, symbol));
+        return reg != ScopedSymbolTable::NONE ? reg : newReg();
+    }
+
+    // Function to get the value of an integer constant, wrapping like a 32-bit int
+    int32_t literalValue(SourceSpan span)
+    {
+        uint32_t value = 0;
+        for(char c : span.text(source))
+            value = value * 10 + uint32_t(c - '0');
+        return int32_t(value);
+    }
+
+    // Function to give value to the caller: as is, or copied into dst when the caller chose a register
+    IrOperand place(IrOperand value, uint32_t dst)
+    {
+        if(dst == IR_NONE)
+            return value;
+        emit(IrOp::COPY, dst, value);
+        return IrOperand::reg(dst);
+    }
+
+    static IrOp binaryOp(TokenKind op)
+    {
+        switch(op)
+        {
+            case TokenKind::OP_PLUS:  return IrOp::ADD;
+            case TokenKind::OP_MINUS: return IrOp::SUB;
+            case TokenKind::OP_MUL:   return IrOp::MUL;
+            case TokenKind::OP_DIV:   return IrOp::DIV;
+            case TokenKind::OP_MOD:   return IrOp::MOD;
+            case TokenKind::OP_LT:    return IrOp::LT;
+            case TokenKind::OP_LE:    return IrOp::LE;
+            case TokenKind::OP_GT:    return IrOp::GT;
+            case TokenKind::OP_GE:    return IrOp::GE;
+            case TokenKind::OP_EQ:    return IrOp::EQ;
+            default:                  return IrOp::NE;
+        }
+    }
+
+    static bool isLogical(const Expr* expr)
+    {
+        if(expr == nullptr || expr->kind != ExprKind::BINARY)
+            return false;
+        TokenKind op = static_cast<const BinaryExpr*>(expr)->op;
+        return op == TokenKind::OP_AND || op == TokenKind::OP_OR;
+    }
+
+    // Function to evaluate expr, into dst unless dst is IR_NONE
+    // dst 只在所有运算数都读完之后才写，所以 a = a + 1 可以直接算进 a 的寄存器
+    IrOperand lowerExpr(const Expr* expr, uint32_t dst)
+    {
+        return deepStack.recurse([&] {
+            return lowerExprBody(expr, dst);
+        });
+    }
+
+    IrOperand lowerExprBody(const Expr* expr, uint32_t dst)
+    {
+        if(expr == nullptr)
+            return place(IrOperand::imm(0), dst);
+        switch(expr->kind)
+        {
+            case ExprKind::INT_LITERAL:
+                return place(IrOperand::imm(literalValue(expr->span)), dst);
+            case ExprKind::NAME:
+            {
+                uint32_t symbol = static_cast<const NameExpr*>(expr)->symbol;
+                return place(IrOperand::reg(variableReg(expr->span, symbol)), dst);
+            }
+            case ExprKind::CALL:
+            {
+                uint32_t result = dst != IR_NONE ? dst : newReg();
+                lowerCall(static_cast<const CallExpr*>(expr), result);
+                return IrOperand::reg(result);
+            }
+            case ExprKind::UNARY:
+            {
+                const UnaryExpr* unary = static_cast<const UnaryExpr*>(expr);
+                if(unary->op == TokenKind::OP_PLUS)
+                    return lowerExpr(unary->operand, dst);
+                IrOperand operand = lowerExpr(unary->operand, IR_NONE);
+                if(unary->op == TokenKind::OP_MINUS && operand.kind == IrOperandKind::IMM) // -123 直接是常量
+                    return place(IrOperand::imm(int32_t(0u - uint32_t(operand.value))), dst);
+                uint32_t result = dst != IR_NONE ? dst : newReg();
+                emit(unary->op == TokenKind::OP_MINUS ? IrOp::NEG : IrOp::NOT, result, operand);
+                return IrOperand::reg(result);
+            }
+            case ExprKind::BINARY:
+            {
+                const BinaryExpr* binary = static_cast<const BinaryExpr*>(expr);
+                uint32_t result = dst != IR_NONE ? dst : newReg();
+                if(isLogical(expr))
+                {
+                    uint32_t ifTrue = newBlock();
+                    uint32_t ifFalse = newBlock();
+                    uint32_t join = newBlock();
+                    lowerCond(expr, ifTrue, ifFalse);
+                    startBlock(ifTrue);
+                    emit(IrOp::COPY, result, IrOperand::imm(1));
+                    jump(join);
+                    startBlock(ifFalse);
+                    emit(IrOp::COPY, result, IrOperand::imm(0));
+                    startBlock(join);
+                    return IrOperand::reg(result);
+                }
+                IrOperand lhs = lowerExpr(binary->lhs, IR_NONE);
+                IrOperand rhs = lowerExpr(binary->rhs, IR_NONE);
+                emit(binaryOp(binary->op), result, lhs, rhs);
+                return IrOperand::reg(result);
+            }
+        }
+        return IrOperand::imm(0);
+    }
+
+    // Function to evaluate the arguments left to right, then pass them and call, the result goes to dst
+    void lowerCall(const CallExpr* call, uint32_t dst)
+    {
+        size_t mark = args.size();
+        for(const Expr* arg : call->args)
+        {
+            IrOperand value = lowerExpr(arg, IR_NONE);
+            args.push_back(value);
+        }
+        for(size_t i = mark; i < args.size(); i++)
+            emit(IrOp::ARG, IR_NONE, args[i]);
+        args.resize(mark);
+        uint32_t id = symbolOf(call->callee, call->symbol);
+        uint32_t index = id < functions.size() ? functions[id] : IR_NONE;
+        emit(IrOp::CALL, dst, IrOperand::function(index), IrOperand::imm(int32_t(call->args.size())));
+    }
+
+    // Function to jump to ifTrue when expr is non-zero and to ifFalse otherwise, && || ! become branches
+    void lowerCond(const Expr* expr, uint32_t ifTrue, uint32_t ifFalse)
+    {
+        deepStack.recurse([&] {
+            lowerCondBody(expr, ifTrue, ifFalse);
+            return true;
+        });
+    }
+
+    void lowerCondBody(const Expr* expr, uint32_t ifTrue, uint32_t ifFalse)
+    {
+        if(isLogical(expr))
+        {
+            const BinaryExpr* binary = static_cast<const BinaryExpr*>(expr);
+            uint32_t rhs = newBlock();
+            if(binary->op == TokenKind::OP_AND)
+                lowerCond(binary->lhs, rhs, ifFalse);
+            else
+                lowerCond(binary->lhs, ifTrue, rhs);
+            startBlock(rhs);
+            lowerCond(binary->rhs, ifTrue, ifFalse);
+            return;
+        }
+        if(expr != nullptr && expr->kind == ExprKind::UNARY && static_cast<const UnaryExpr*>(expr)->op == TokenKind::OP_NOT)
+        {
+            lowerCond(static_cast<const UnaryExpr*>(expr)->operand, ifFalse, ifTrue);
+            return;
+        }
+        branch(lowerExpr(expr, IR_NONE), ifTrue, ifFalse);
+    }
+
+    void lowerStmts(const NodeList<Stmt>& stmts)
+    {
+        for(const Stmt* stmt : stmts)
+            lowerStmt(stmt);
+    }
+
+    // Function to lower the body of an if or while, which gets a scope of its own
+    void lowerSubStmt(const Stmt* stmt)
+    {
+        if(stmt == nullptr || stmt->kind == StmtKind::BLOCK)
+        {
+            lowerStmt(stmt);
+            return;
+        }
+        variables.enterScope();
+        lowerStmt(stmt);
+        variables.exitScope();
+    }
+
+    void lowerStmt(const Stmt* stmt)
+    {
+        deepStack.recurse([&] {
+            lowerStmtBody(stmt);
+            return true;
+        });
+    }
+
+    void lowerStmtBody(const Stmt* stmt)
+    {
+        if(stmt == nullptr)
+            return;
+        switch(stmt->kind)
+        {
+            case StmtKind::BLOCK:
+                variables.enterScope();
+                lowerStmts(static_cast<const BlockStmt*>(stmt)->stmts);
+                variables.exitScope();
+                break;
+            case StmtKind::EXPR:
+            {
+                const Expr* expr = static_cast<const ExprStmt*>(stmt)->expr;
+                if(expr != nullptr && expr->kind == ExprKind::CALL)
+                    lowerCall(static_cast<const CallExpr*>(expr), IR_NONE); // 不用返回值
+                else
+                    lowerExpr(expr, IR_NONE);
+                break;
+            }
+            case StmtKind::ASSIGN:
+            {
+                const AssignStmt* assign = static_cast<const AssignStmt*>(stmt);
+                lowerExpr(assign->value, variableReg(assign->name, assign->symbol));
+                break;
+            }
+            case StmtKind::DECL:
+                for(const VarDecl* var : static_cast<const DeclStmt*>(stmt)->vars)
+                {
+                    uint32_t reg = newReg();
+                    if(var->init != nullptr)
+                        lowerExpr(var->init, reg); // 初始化表达式里的同名变量还是外层的
+                    variables.declare(symbolOf(var->name, var->symbol), reg);
+                }
+                break;
+            case StmtKind::IF:
+            {
+                const IfStmt* ifStmt = static_cast<const IfStmt*>(stmt);
+                uint32_t thenBlock = newBlock();
+                uint32_t elseBlock = ifStmt->elseStmt != nullptr ? newBlock() : IR_NONE;
+                uint32_t join = newBlock();
+                lowerCond(ifStmt->cond, thenBlock, elseBlock != IR_NONE ? elseBlock : join);
+                startBlock(thenBlock);
+                lowerSubStmt(ifStmt->thenStmt);
+                if(elseBlock != IR_NONE)
+                {
+                    jumpIfOpen(join);
+                    startBlock(elseBlock);
+                    lowerSubStmt(ifStmt->elseStmt);
+                }
+                startBlock(join);
+                break;
+            }
+            case StmtKind::WHILE:
+            {
+                const WhileStmt* whileStmt = static_cast<const WhileStmt*>(stmt);
+                uint32_t cond = newBlock();
+                uint32_t body = newBlock();
+                uint32_t exit = newBlock();
+                startBlock(cond);
+                lowerCond(whileStmt->cond, body, exit);
+                startBlock(body);
+                loops.push_back(Loop{cond, exit});
+                lowerSubStmt(whileStmt->body);
+                loops.pop_back();
+                jumpIfOpen(cond);
+                startBlock(exit);
+                break;
+            }
+            case StmtKind::BREAK:
+                if(!loops.empty())
+                    jump(loops.back().breakTarget);
+                break;
+            case StmtKind::CONTINUE:
+                if(!loops.empty())
+                    jump(loops.back().continueTarget);
+                break;
+            case StmtKind::RETURN:
+            {
+                const Expr* value = static_cast<const ReturnStmt*>(stmt)->value;
+                ret(value != nullptr ? lowerExpr(value, IR_NONE) : IrOperand::none());
+                break;
+            }
+        }
+    }
+
+    // Function to follow target through blocks that only jump on
+    // 嵌套的 if 和 while 结束处常有一长串这样的空块：走过的空块都改成直接跳到终点，以后再经过时一步就到，
+    // 整个函数合起来是线性的。全是空块的环（while(1) continue;）停在第一个又走到的块上
+    uint32_t skipEmptyBlocks(uint32_t target)
+    {
+        worklist.clear();
+        while(blocks[target].count == 0 && blocks[target].term.kind == IrTermKind::JUMP
+              && blocks[target].newIndex != ON_PATH)
+        {
+            blocks[target].newIndex = ON_PATH;
+            worklist.push_back(target);
+            target = blocks[target].term.target[0];
+        }
+        for(uint32_t block : worklist)
+        {
+            blocks[block].term.target[0] = target;
+            blocks[block].newIndex = IR_NONE;
+        }
+        return target;
+    }
+
+    // Function to drop the blocks the entry cannot reach and copy the rest into the function's arena
+    std::unique_ptr<IrFunction> finishFunction(const FuncDef* func)
+    {
+        for(uint32_t block : order)
+        {
+            for(uint32_t& target : blocks[block].term.target)
+            {
+                if(target != IR_NONE)
+                    target = skipEmptyBlocks(target);
+            }
+        }
+        worklist.assign(1, 0);
+        blocks[0].newIndex = 0;
+        while(!worklist.empty())
+        {
+            const IrTerminator& term = blocks[worklist.back()].term;
+            worklist.pop_back();
+            for(uint32_t target : term.target)
+            {
+                if(target != IR_NONE && blocks[target].newIndex == IR_NONE)
+                {
+                    blocks[target].newIndex = 0; // 先只标记到得了，编号按生成顺序另给
+                    worklist.push_back(target);
+                }
+            }
+        }
+
+        finalInsts.clear();
+        finalBlocks.clear();
+        for(uint32_t block : order)
+        {
+            ScratchBlock& scratch = blocks[block];
+            if(scratch.newIndex == IR_NONE)
+                continue;
+            scratch.newIndex = uint32_t(finalBlocks.size());
+            finalBlocks.push_back(IrBlock{nullptr, scratch.count, scratch.term});
+            finalInsts.insert(finalInsts.end(), insts.begin() + scratch.begin, insts.begin() + scratch.begin + scratch.count);
+        }
+
+        size_t bytes = finalInsts.size() * sizeof(IrInst) + finalBlocks.size() * sizeof(IrBlock)
+                     + alignof(IrInst) + alignof(IrBlock);
+        std::unique_ptr<IrFunction> ir(new IrFunction{func->returnType, func->name, func->params.size(), nextReg,
+                                                      nullptr, uint32_t(finalBlocks.size()), Arena(bytes)});
+        IrInst* code = ir->arena.copyArray(finalInsts.data(), finalInsts.size());
+        uint32_t offset = 0;
+        for(IrBlock& block : finalBlocks)
+        {
+            block.insts = block.instCount > 0 ? code + offset : nullptr;
+            offset += block.instCount;
+            for(uint32_t& target : block.term.target)
+            {
+                if(target != IR_NONE)
+                    target = blocks[target].newIndex;
+            }
+        }
+        ir->blocks = ir->arena.copyArray(finalBlocks.data(), finalBlocks.size());
+        return ir;
+    }
+
+    std::unique_ptr<IrFunction> lowerFunc(const FuncDef* func)
+    {
+        blocks.clear();
+        order.clear();
+        insts.clear();
+        current = IR_NONE;
+        nextReg = 0;
+        variables.enterScope();
+        for(const Param* param : func->params)
+            variables.declare(symbolOf(param->name, param->symbol), newReg());
+        startBlock(newBlock());
+        if(func->body != nullptr)
+            lowerStmts(func->body->stmts); // 形参和最外层的 Block 是同一个作用域
+        if(current != IR_NONE) // 执行到函数末尾；语义检查保证 int 函数不会走到这里，仍给一个确定的返回值
+            ret(func->returnType == TokenKind::KW_INT ? IrOperand::imm(0) : IrOperand::none());
+        variables.exitScope();
+        return finishFunction(func);
+    }
+
+public:
+    // source 是 AST 中位置所指的源码；interner 可以和词法分析共用
+    IrGenerator(std::string_view text, Interner& names)
+        : source(text)
+        , interner(names)
+        , current(IR_NONE)
+        , nextReg(0)
+    {}
+
+    IrGenerator(const IrGenerator&) = delete;
+    IrGenerator& operator=(const IrGenerator&) = delete;
+
+    // Function to lower every FuncDef of unit, a function's index in the module is its index in unit
+    IrModule generate(const CompUnit* unit)
+    {
+        IrModule module;
+        uint32_t index = 0;
+        for(const FuncDef* func : unit->funcs)
+        {
+            uint32_t id = symbolOf(func->name, func->symbol);
+            if(id >= functions.size())
+                functions.resize(size_t(id) + 1, IR_NONE);
+            if(functions[id] == IR_NONE)
+                functions[id] = index;
+            index++;
+        }
+        module.functions.reserve(unit->funcs.size());
+        for(const FuncDef* func : unit->funcs)
+            module.functions.push_back(lowerFunc(func));
+        return module;
+    }
+};
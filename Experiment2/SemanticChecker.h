@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "../Common/Interner.h"
+#include "../Common/ScopedSymbolTable.h"
+#include "../Common/TokenKind.h"
+#include "Ast.h"
+#include "Diagnostics.h"
+
+// 随语法分析一起做的语义检查：语法分析器在读到相应的结构时调用下面的方法（见 checkSemantics()），
+// 不需要语法树，也不需要第二遍遍历。检查的内容有未声明或重复声明的变量、未定义或重复定义的函数、
+// while 之外的 break / continue、int 函数缺少 return、return 与返回类型不符、实参个数不对。
+// 变量按块作用域解析：形参和函数体最外层的 Block 是同一个作用域，if / while 的语句体不是 Block 时自成一个作用域；
+// 声明的初始化表达式先于这个名字生效，int a = a; 里右边的 a 指外层的 a。
+// 函数可以先调用后定义：调用时还没见过的函数记进待定列表，到 CompUnit 末尾再核对。
+// 判断“是否缺少 return”时不假定循环会执行，if 只有两个分支都 return 才算 return 了。
+// 名字按符号 ID 比较：词法分析已经驻留过的直接用它给的 ID，没有 ID 时才按文字驻留到同一张表里
+
+// Class that collects semantic errors from the hooks the parser calls while it reads the input
+class SemanticChecker {
+private:
+    struct Function {
+        uint32_t paramCount;
+        TokenKind returnType; // 没有这个函数时为 END_OF_FILE
+    };
+
+    struct PendingCall {
+        uint32_t id;
+        uint32_t argCount;
+        SourceSpan callee;
+    };
+
+    std::string_view source;
+    Interner& interner;
+    ScopedSymbolTable variables;
+    std::vector<Function> functions; // 按符号 ID 下标
+    std::vector<PendingCall> pendingCalls;
+    Diagnostics diagnostics;
+    TokenKind returnType; // 正在分析的函数的返回类型
+    uint32_t loopDepth;
+
+    uint32_t symbolOf(SourceSpan name, uint32_t symbol)
+    {
+        return symbol != Interner::NONE ? symbol : interner.intern(name.text(source));
+    }
+
+    const Function* findFunction(uint32_t id) const
+    {
+        if(id >= functions.size() || functions[id].returnType == TokenKind::END_OF_FILE)
+            return nullptr;
+        return &functions[id];
+    }
+
+    void report(DiagnosticCode code, SourceSpan span, uint64_t expected = 0)
+    {
+        diagnostics.report(code, span, expected);
+    }
+
+public:
+    // source 是 token 偏移所指的源码；table 是词法分析驻留标识符用的那张表，符号 ID 要出自同一张表
+    SemanticChecker(std::string_view text, Interner& table)
+        : source(text)
+        , interner(table)
+        , returnType(TokenKind::KW_VOID)
+        , loopDepth(0)
+    {}
+
+    SemanticChecker(const SemanticChecker&) = delete;
+    SemanticChecker& operator=(const SemanticChecker&) = delete;
+
+    // Function to start a FuncDef once its header has been read, the parameters follow through declare()
+    void beginFunc(TokenKind type, SourceSpan name, uint32_t symbol, uint32_t paramCount)
+    {
+        uint32_t id = symbolOf(name, symbol);
+        if(findFunction(id) != nullptr)
+            report(DiagnosticCode::REDEFINED_FUNCTION, name);
+        else
+        {
+            if(id >= functions.size())
+                functions.resize(size_t(id) + 1, Function{0, TokenKind::END_OF_FILE});
+            functions[id] = Function{paramCount, type};
+        }
+        returnType = type;
+        loopDepth = 0;
+    }
+
+    // Function to finish a FuncDef, fallsThrough tells whether its body can run off the end
+    void endFunc(SourceSpan name, bool fallsThrough)
+    {
+        if(returnType == TokenKind::KW_INT && fallsThrough)
+            report(DiagnosticCode::MISSING_RETURN, name);
+    }
+
+    // Function to check the calls to functions defined after the call, at the end of the CompUnit
+    void endUnit()
+    {
+        for(const PendingCall& call : pendingCalls)
+        {
+            const Function* callee = findFunction(call.id);
+            if(callee == nullptr)
+                report(DiagnosticCode::UNKNOWN_FUNCTION, call.callee);
+            else if(callee->paramCount != call.argCount)
+                report(DiagnosticCode::ARGUMENT_COUNT, call.callee, callee->paramCount);
+        }
+        pendingCalls.clear();
+    }
+
+    void enterScope() { variables.enterScope(); }
+    void exitScope() { variables.exitScope(); }
+    void enterLoop() { loopDepth++; }
+    void exitLoop() { loopDepth--; }
+
+    // Function to declare a parameter or variable in the innermost scope
+    void declare(SourceSpan name, uint32_t symbol)
+    {
+        if(!variables.declare(symbolOf(name, symbol), 0))
+            report(DiagnosticCode::REDECLARED_VARIABLE, name);
+    }
+
+    // Function to check a variable that is read or assigned
+    void use(SourceSpan name, uint32_t symbol)
+    {
+        if(variables.lookup(symbolOf(name, symbol)) == ScopedSymbolTable::NONE)
+            report(DiagnosticCode::UNDECLARED_VARIABLE, name);
+    }
+
+    void call(SourceSpan callee, uint32_t symbol, uint32_t argCount)
+    {
+        uint32_t id = symbolOf(callee, symbol);
+        const Function* function = findFunction(id);
+        if(function == nullptr)
+            pendingCalls.push_back(PendingCall{id, argCount, callee});
+        else if(function->paramCount != argCount)
+            report(DiagnosticCode::ARGUMENT_COUNT, callee, function->paramCount);
+    }
+
+    // Function to check a break or continue statement
+    void jump(SourceSpan statement)
+    {
+        if(loopDepth == 0)
+            report(DiagnosticCode::JUMP_OUTSIDE_LOOP, statement);
+    }
+
+    void returnStmt(SourceSpan statement, bool hasValue)
+    {
+        if(returnType == TokenKind::KW_VOID && hasValue)
+            report(DiagnosticCode::VOID_RETURNS_VALUE, statement);
+        else if(returnType == TokenKind::KW_INT && !hasValue)
+            report(DiagnosticCode::RETURN_WITHOUT_VALUE, statement);
+    }
+
+    // 按报告的顺序，待定调用的错误在最后；输出前和语法错误一样要 finish()
+    const Diagnostics& getDiagnostics() const { return diagnostics; }
+};
@@ -1,8 +1,26 @@
 #include<bits/stdc++.h>
+#include "../Common/CharClass.h"
+#include "../Common/DeepStack.h"
+#include "../Common/Interner.h"
+#include "../Common/Keywords.h"
+#include "../Common/LineIndex.h"
+#include "../Common/OutputBuffer.h"
+#include "../Common/Scan.h"
+#include "../Common/SourceBuffer.h"
+#include "../Common/SpscRing.h"
+#include "../Common/WorkStealing.h"
+#include "Ast.h"
+#include "Diagnostics.h"
+#include "FlatAst.h"
+#include "Ir.h"
+#include "IrGenerator.h"
+#include "SemanticChecker.h"
+#include "TokenBuffer.h"
+#include "TokenCache.h"
 using namespace std;
 
 // Enum class to define different types of tokens
-enum class TokenType {
+enum class TokenType : uint8_t {
     KEYWORD,
     IDENTIFIER,
     INTEGER_LITERAL,
@@ -12,100 +30,60 @@ enum class TokenType {
     END_OF_FILE
 };
 
-// Struct to represent a token with its type and value
+// Function to get the coarse TokenType of a TokenKind, used by the token dump
+TokenType tokenTypeOf(TokenKind kind)
+{
+    if(kind == TokenKind::IDENTIFIER) return TokenType::IDENTIFIER;
+    if(kind == TokenKind::INTEGER_LITERAL) return TokenType::INTEGER_LITERAL;
+    if(kind <= TokenKind::KW_VOID) return TokenType::KEYWORD;
+    if(kind <= TokenKind::OP_PIPE) return TokenType::OPERATOR;
+    if(kind <= TokenKind::P_COMMA) return TokenType::PUNCTUATOR;
+    if(kind == TokenKind::UNKNOWN) return TokenType::UNKNOWN;
+    return TokenType::END_OF_FILE;
+}
+
+// Struct to represent a token with its type and position
+// token 不再持有自己的字符串，只记录在源码缓冲区中的偏移和长度；行号由 LineIndex 按偏移查出
 struct Token {
+    uint32_t offset;
+    uint32_t length;
     TokenType type;
-    string value;
-    int line; // 行号信息
+    TokenKind kind;
 
-    Token(TokenType t, const string& v, int l = 0)
-        : type(t)
-        , value(v)
-        , line(l)
+    Token(TokenKind k, uint32_t off, uint32_t len)
+        : offset(off)
+        , length(len)
+        , type(tokenTypeOf(k))
+        , kind(k)
         {}
+
+    // Function to get the token text, only materialized on demand
+    string_view text(string_view source) const
+    {
+        return string_view(source.data() + offset, length);
+    }
 };
 
 // Class that implements the lexical analyzer
 class LexicalAnalyzer {
 private:
-    string input;
+    string_view input; // 指向调用者持有的源码缓冲区，词法分析器本身不拷贝
     size_t position;
-    int currentLine; //当前的行号
-    unordered_map<string, TokenType> keywords;
-
-    // Function to initialize the keywords map
-    void initKeywords()
-    {
-        keywords["int"] = TokenType::KEYWORD;
-        keywords["if"] = TokenType::KEYWORD;
-        keywords["else"] = TokenType::KEYWORD;
-        keywords["while"] = TokenType::KEYWORD;
-        keywords["break"] = TokenType::KEYWORD;
-        keywords["continue"] = TokenType::KEYWORD;
-        keywords["return"] = TokenType::KEYWORD;
-        keywords["void"] = TokenType::KEYWORD;
-    }
-
-    // Function to check if a character is whitespace
-    bool isWhitespace(char c)
-    {
-        return c == ' ' || c == '\t' || c == '\n'
-                || c == '\r';
-    }
-
-    // Function to check if a character is alphabetic
-    bool isAlpha(char c)
-    {
-        return (c >= 'a' && c <= 'z')
-                || (c >= 'A' && c <= 'Z');
-    }
-
-    // Function to check if a character is digit
-    bool isDigit(char c)
-    {
-        return c >= '0' && c <= '9';
-    }
-
-    // Function to check if a character is alphanumeric
-    bool isAlphaNumeric(char c)
-    {
-        return isAlpha(c) || isDigit(c);
-    }
-
-    // Function to check if a character is a OPERATOR
-    bool isOPERATOR(char c)
-    {
-        return c == '+' || c == '-' || c == '*' || c == '/' || c == '%'
-                || c == '=' || c == '<' || c == '>' || c == '!'
-                || c == '&' || c == '|';
-    }
-
-    // Function to check if a character is a punctuator
-    bool isPunctuator(char c)
-    {
-        return c == '(' || c == ')' || c == '{' || c == '}'
-                || c == ';' || c == ',';
-    }
-    
-    // Function to check if a character is a underscore
-    bool isUnderscore(char c)
-    {
-        return c == '_';
-    }
+    size_t limit;     // 分析到这里为止，整个文件分析时就是输入的长度
+    size_t endOffset; // END_OF_FILE token 的偏移
+    bool inComment;   // 停在了一个没有闭合的块注释里
+    Interner* interner; // 不为空时每个标识符都驻留到这里
+    uint32_t symbol;    // 最近一个标识符的符号 ID
 
     // Function to skip LineComment
     void skipLineComment()
     {
         if(position +1 < input.length() && input[position] == '/' && input[position+1] == '/')
             position += 2;
-        while(position < input.length() && input[position] != '\n')
+        const char* begin = input.data();
+        position = scanFindByte(begin + position, begin + input.length(), '\n') - begin;
+        if(position < input.length())
             position++;
-        if(position < input.length() && input[position] == '\n')
-        {
-            position++;
-            currentLine++;
-        }
-
     }
 
     // Function to skip BlockComment
@@ -113,37 +91,56 @@ private:
     {
         if(position+1 < input.length() && input[position] == '/' && input[position+1] == '*')
             position += 2;
-        while(position+1 < input.length())
+        skipCommentBody();
+    }
+
+    // Function to skip to just after the "*/" that closes the block comment we are in
+    // 只在 limit 之前找：分块分析时找不到说明注释延续到了下一块
+    void skipCommentBody()
+    {
+        if(position+1 >= limit)
         {
-            if(input[position] == '\n')
-                currentLine++;
-            if(input[position] == '*' && input[position+1] == '/')
+            position = limit;
+            inComment = true;
+            endOffset = input.length() - 1;
+            return;
+        }
+        // 只在 [p, last) 中找 '*'，保证 '*' 后面还有一个字符可看
+        const char* begin = input.data();
+        const char* p = begin + position;
+        const char* last = begin + min(limit, input.length() - 1);
+        while(true)
+        {
+            const char* star = scanFindByte(p, last, '*');
+            if(star == last)
+                break;
+            if(star[1] == '/')
             {
-                position += 2;
+                position = star - begin + 2;
                 return ;
             }
-            position++;
+            p = star + 1;
         }
-        position = input.length(); // 当最后没有终结*/的时候，到了程序结尾
+        position = limit; // 当最后没有终结*/的时候，到了程序结尾
+        inComment = true;
+        // 旧实现不计最后一个字节上的换行，END_OF_FILE 停在该字节上以保持报错行号不变
+        endOffset = input.length() - 1;
     }
 
     // Function to get the next word
-    string getNextWord()
+    string_view getNextWord()
     {
         size_t start = position;
-        while(position < input.length()
-               && (isAlphaNumeric(input[position]) || isUnderscore(input[position])))
-        {
-            position++;
-        }
+        const char* begin = input.data();
+        position = scanIdentifierEnd(begin + position, begin + input.length()) - begin;
         return input.substr(start, position - start);
     }
 
     // Function to get the next number
-    string getNextNumber()
+    string_view getNextNumber()
     {
         size_t start = position;
-        while(position < input.length() && isDigit(input[position]))
+        while(position < input.length() && (charClassOf(input[position]) & CHAR_DIGIT))
         {
             position++;
         }
@@ -151,10 +148,10 @@ private:
     }
 
     // Function to get the next OPERATOR
-    string getNextOPERATOR()
+    string_view getNextOPERATOR()
     {
         size_t start = position;
-        string two;
+        string_view two;
         if(start + 1 < input.length())
         {
             two = input.substr(start, 2);
@@ -170,58 +167,148 @@ private:
         return input.substr(start, 1);
     }
 
-    string getNextPunctuator()
+    string_view getNextPunctuator()
     {
         size_t start = position;
         position++;
         return input.substr(start, 1);
     }
 
+    // Function to get the kind of an operator returned by getNextOPERATOR
+    TokenKind getOPERATORKind(string_view op)
+    {
+        if(op.length() == 2)
+        {
+            switch(op[0])
+            {
+                case '=': return TokenKind::OP_EQ;
+                case '!': return TokenKind::OP_NE;
+                case '<': return TokenKind::OP_LE;
+                case '>': return TokenKind::OP_GE;
+                case '&': return TokenKind::OP_AND;
+                default:  return TokenKind::OP_OR;
+            }
+        }
+        switch(op[0])
+        {
+            case '+': return TokenKind::OP_PLUS;
+            case '-': return TokenKind::OP_MINUS;
+            case '*': return TokenKind::OP_MUL;
+            case '/': return TokenKind::OP_DIV;
+            case '%': return TokenKind::OP_MOD;
+            case '<': return TokenKind::OP_LT;
+            case '>': return TokenKind::OP_GT;
+            case '!': return TokenKind::OP_NOT;
+            case '=': return TokenKind::OP_ASSIGN;
+            case '&': return TokenKind::OP_AMP;
+            default:  return TokenKind::OP_PIPE;
+        }
+    }
+
+    // Function to get the kind of a punctuator
+    TokenKind getPunctuatorKind(char c)
+    {
+        switch(c)
+        {
+            case '(': return TokenKind::P_LPAREN;
+            case ')': return TokenKind::P_RPAREN;
+            case '{': return TokenKind::P_LBRACE;
+            case '}': return TokenKind::P_RBRACE;
+            case ';': return TokenKind::P_SEMI;
+            default:  return TokenKind::P_COMMA;
+        }
+    }
+
+    // Function to build a token from a slice of the input
+    Token makeToken(TokenKind kind, string_view text)
+    {
+        return Token(kind, uint32_t(text.data() - input.data()), uint32_t(text.size()));
+    }
+
 public: 
     // Constructor for LexicalAnalyzer
-    LexicalAnalyzer(const string& source)
+    LexicalAnalyzer(string_view source)
         : input(source)
         , position(0)
-        , currentLine(1)
+        , limit(source.length())
+        , endOffset(source.length())
+        , inComment(false)
+        , interner(nullptr)
+        , symbol(Interner::NONE)
+    {}
+
+    // Constructor for lexing only the tokens that start in [begin, end), used by the parallel lexer
+    // end 必须紧跟在一个 '\n' 之后或者就是输入的长度：这样没有 token 会跨过它，
+    // 一块开头的状态只有两种，在普通代码中，或者在一个块注释里
+    LexicalAnalyzer(string_view source, size_t begin, size_t end)
+        : input(source)
+        , position(begin)
+        , limit(end)
+        , endOffset(source.length())
+        , inComment(false)
+        , interner(nullptr)
+        , symbol(Interner::NONE)
+    {}
+
+    // Function to intern every identifier from now on, table must outlive the lexer
+    void internInto(Interner& table)
     {
-        initKeywords();
+        interner = &table;
     }
 
-    // Function to tokenize the input string
-    vector<Token> tokenize()
+    // Function to get the symbol ID of the identifier nextToken() just returned
+    uint32_t lastSymbol() const
     {
-        vector<Token> tokens;
+        return symbol;
+    }
 
-        while(position < input.length())
+    bool interning() const
+    {
+        return interner != nullptr;
+    }
+
+    // Function to start as if the current position were inside a block comment
+    void resumeInBlockComment()
+    {
+        skipCommentBody();
+    }
+
+    // Function to tell whether lexing stopped inside a block comment that is not closed before the limit
+    bool endsInComment() const
+    {
+        return inComment;
+    }
+
+    // Function to get the next token, END_OF_FILE is returned again once the input is exhausted
+    // 拉取式接口：每次只分析出一个 token，语法分析器可以边分析边取
+    Token nextToken()
+    {
+        while(position < limit)
         {
             char currentChar = input[position];
+            uint8_t charClass = charClassOf(currentChar); // 一次查表得到该字符的全部分类
 
             // Skip whitespace
-            if(isWhitespace(currentChar))
+            if(charClass & CHAR_WHITESPACE)
             {
-                if(currentChar == '\n')
-                    currentLine++;
-                position++;
+                const char* begin = input.data();
+                position = scanWhitespaceEnd(begin + position, begin + input.length()) - begin;
                 continue;
             }
 
             // Identify keywords or identifiers 还有下划线开头
-            if(isAlpha(currentChar) || isUnderscore(currentChar))
+            if(charClass & CHAR_IDENT_START)
             {
-                string word = getNextWord();
-                if(keywords.find(word) != keywords.end()) //identify keywords
-                {
-                    tokens.emplace_back(TokenType::KEYWORD, word, currentLine);
-                }
-                else 
-                {
-                    tokens.emplace_back(TokenType::IDENTIFIER, word, currentLine);
-                }
+                string_view word = getNextWord();
+                TokenKind kind = lookupKeyword(word); //identify keywords
+                if(interner != nullptr && kind == TokenKind::IDENTIFIER)
+                    symbol = interner->intern(word);
+                return makeToken(kind, word);
             }
-            else if(isDigit(currentChar)) // identify integer
+            else if(charClass & CHAR_DIGIT) // identify integer
             {
-                string number = getNextNumber();
-                tokens.emplace_back(TokenType::INTEGER_LITERAL, number, currentLine);
+                string_view number = getNextNumber();
+                return makeToken(TokenKind::INTEGER_LITERAL, number);
             }
             else if(currentChar == '/') //遇到/的时候判断是注释还是运算符
             {
@@ -237,79 +324,688 @@ public:
                 }
                 else
                 {
-                    string op = getNextOPERATOR();
-                    tokens.emplace_back(TokenType::OPERATOR,op, currentLine);
+                    string_view op = getNextOPERATOR();
+                    return makeToken(getOPERATORKind(op), op);
                 }
             }
-            else if(isOPERATOR(currentChar))
+            else if(charClass & CHAR_OPERATOR)
             {
-                string op = getNextOPERATOR(); 
-                tokens.emplace_back(TokenType::OPERATOR, op, currentLine);
+                string_view op = getNextOPERATOR(); 
+                return makeToken(getOPERATORKind(op), op);
             }
-            else if(isPunctuator(currentChar))
+            else if(charClass & CHAR_PUNCTUATOR)
             {
-                string punct = getNextPunctuator();
-                tokens.emplace_back(TokenType::PUNCTUATOR, punct, currentLine);
+                string_view punct = getNextPunctuator();
+                return makeToken(getPunctuatorKind(punct[0]), punct);
             }
             else // unknown character
             {
-                tokens.emplace_back(TokenType::UNKNOWN, string(1, currentChar), currentLine);
                 position++;
+                return makeToken(TokenKind::UNKNOWN, input.substr(position - 1, 1));
             }
         }
 
-        tokens.emplace_back(TokenType::END_OF_FILE, "", currentLine);
+        return Token(TokenKind::END_OF_FILE, uint32_t(endOffset), 0);
+    }
+
+    // Function to tokenize the input string
+    vector<Token> tokenize()
+    {
+        vector<Token> tokens;
+        do
+        {
+            tokens.push_back(nextToken());
+        } while(tokens.back().kind != TokenKind::END_OF_FILE);
         return tokens;
     }
+
+    // Function to tokenize the input string into struct-of-arrays storage
+    void tokenize(TokenBuffer& out)
+    {
+        Token token = nextToken();
+        while(true)
+        {
+            if(interner != nullptr)
+                out.push(token.kind, token.offset, token.length,
+                         token.kind == TokenKind::IDENTIFIER ? symbol : Interner::NONE);
+            else
+                out.push(token.kind, token.offset, token.length);
+            if(token.kind == TokenKind::END_OF_FILE)
+                break;
+            token = nextToken();
+        }
+    }
+};
+
+// 并行词法分析：把源码在换行处切成若干块，每块在自己的线程上分析。
+// 换行不会出现在 token 中间，所以块首的状态只可能是“普通代码”或“在块注释里”，
+// 两种都先假设着分析，等前一块的结尾状态确定后再挑出正确的那一种拼起来。
+// “在注释里”的分析一旦在某个 token 的开头与“普通”的分析对上，之后的 token 必然相同，
+// 所以它只记录对上之前的那一小段。token 记录的是绝对偏移，拼接时不需要修正，
+// 各块 token 数的前缀和给出每块在结果中的位置，拷贝也是并行的。
+
+const size_t PARALLEL_LEX_MIN_CHUNK = 1 << 20; // 小于 1MB 的块不值得一个线程
+
+// Struct to represent the two speculative results of lexing one chunk
+struct LexChunk {
+    size_t begin;
+    size_t end;
+    vector<Token> tokens;        // 块首在普通代码中时的 token
+    bool endsInComment;
+    vector<Token> commentPrefix; // 块首在块注释里时，与 tokens 对上之前的 token
+    size_t joinIndex;            // 对上之后沿用 tokens[joinIndex..]
+    bool commentEndsInComment;
 };
 
-// all functions below for print name
-string getKeyWordName(const Token& token)
+// Function to lex one chunk under both assumptions about its start state
+void lexChunk(string_view source, LexChunk& chunk)
 {
-    return string("'") + token.value + "'";
+    LexicalAnalyzer normal(source, chunk.begin, chunk.end);
+    for(Token token = normal.nextToken(); token.kind != TokenKind::END_OF_FILE; token = normal.nextToken())
+        chunk.tokens.push_back(token);
+    chunk.endsInComment = normal.endsInComment();
+
+    LexicalAnalyzer comment(source, chunk.begin, chunk.end);
+    comment.resumeInBlockComment();
+    size_t j = 0;
+    while(true)
+    {
+        Token token = comment.nextToken();
+        if(token.kind == TokenKind::END_OF_FILE)
+        {
+            chunk.joinIndex = chunk.tokens.size();
+            chunk.commentEndsInComment = comment.endsInComment();
+            return;
+        }
+        while(j < chunk.tokens.size() && chunk.tokens[j].offset < token.offset)
+            j++;
+        if(j < chunk.tokens.size() && chunk.tokens[j].offset == token.offset)
+        {
+            chunk.joinIndex = j;
+            chunk.commentEndsInComment = chunk.endsInComment;
+            return;
+        }
+        chunk.commentPrefix.push_back(token);
+    }
 }
 
+// Function to tokenize source using several threads, the result equals LexicalAnalyzer(source).tokenize()
+vector<Token> tokenizeInParallel(string_view source, unsigned threads)
+{
+    // 块数取线程数的几倍，留给工作窃取去平衡；每块的结尾挪到下一个换行之后
+    size_t length = source.length();
+    size_t chunkCount = min(size_t(threads) * 4, length / PARALLEL_LEX_MIN_CHUNK);
+    if(threads <= 1 || chunkCount <= 1)
+        return LexicalAnalyzer(source).tokenize();
+    vector<LexChunk> chunks;
+    size_t begin = 0;
+    for(size_t i = 1; i <= chunkCount && begin < length; i++)
+    {
+        size_t end = length;
+        if(i < chunkCount)
+        {
+            const char* p = source.data() + max(begin, length / chunkCount * i);
+            const char* newline = scanFindByte(p, source.data() + length, '\n');
+            end = min(length, size_t(newline - source.data()) + 1);
+        }
+        chunks.push_back(LexChunk{begin, end, {}, false, {}, 0, false});
+        begin = end;
+    }
+
+    runWorkStealing(chunks.size(), threads, [&](size_t i) {
+        lexChunk(source, chunks[i]);
+    });
+
+    // 从第一块开始，按前一块的结尾状态选定每一块的结果，同时算出每块在结果中的起点
+    vector<bool> startsInComment(chunks.size());
+    vector<size_t> outputStart(chunks.size() + 1, 0);
+    bool inComment = false;
+    for(size_t i = 0; i < chunks.size(); i++)
+    {
+        const LexChunk& chunk = chunks[i];
+        startsInComment[i] = inComment;
+        size_t count = inComment ? chunk.commentPrefix.size() + chunk.tokens.size() - chunk.joinIndex
+                                 : chunk.tokens.size();
+        outputStart[i + 1] = outputStart[i] + count;
+        inComment = inComment ? chunk.commentEndsInComment : chunk.endsInComment;
+    }
+
+    vector<Token> tokens(outputStart.back() + 1, Token(TokenKind::END_OF_FILE, 0, 0));
+    runWorkStealing(chunks.size(), threads, [&](size_t i) {
+        LexChunk& chunk = chunks[i];
+        Token* out = tokens.data() + outputStart[i];
+        size_t from = 0;
+        if(startsInComment[i])
+        {
+            out = copy(chunk.commentPrefix.begin(), chunk.commentPrefix.end(), out);
+            from = chunk.joinIndex;
+        }
+        copy(chunk.tokens.begin() + from, chunk.tokens.end(), out);
+        vector<Token>().swap(chunk.tokens); // 拷完就释放，峰值内存不到两份 token
+        vector<Token>().swap(chunk.commentPrefix);
+    });
+    // 与 LexicalAnalyzer 一样，停在未闭合的块注释里时 END_OF_FILE 落在最后一个字节上
+    tokens.back() = Token(TokenKind::END_OF_FILE, uint32_t(inComment ? length - 1 : length), 0);
+    return tokens;
+}
 
-string getOPERATORName(const Token& token)
+// Function to intern the identifiers of a complete token sequence
+// 返回与 tokens 一一对应的符号 ID，不是标识符的位置为 Interner::NONE
+vector<uint32_t> internIdentifiers(const vector<Token>& tokens, string_view source, Interner& interner)
 {
-    return string("'") + token.value + "'";
+    vector<uint32_t> symbols(tokens.size(), Interner::NONE);
+    for(size_t i = 0; i < tokens.size(); i++)
+    {
+        if(tokens[i].kind == TokenKind::IDENTIFIER)
+            symbols[i] = interner.intern(tokens[i].text(source));
+    }
+    return symbols;
 }
 
-string getPunctuatorName(const Token& token)
+// Function to intern the identifiers of a mapped token cache, the IDs the lexer would have given
+// 缓存命中时跳过了词法分析，语义检查要的符号 ID 和 --intern-stats 的统计只能从缓存里的 token 补出来
+vector<uint32_t> internIdentifiers(const TokenCache& tokens, string_view source, Interner& interner)
 {
-    return string("'") + token.value + "'";
+    vector<uint32_t> symbols(tokens.size(), Interner::NONE);
+    for(size_t i = 0; i < tokens.size(); i++)
+    {
+        if(tokens.kind(i) == TokenKind::IDENTIFIER)
+            symbols[i] = interner.intern(source.substr(tokens.offset(i), tokens.length(i)));
+    }
+    return symbols;
 }
 
-// Function to convert TokenType to string for printing 
-string getTokenTypeName(TokenType type, const Token& token)
+// Function to intern the identifiers of a token sequence on several threads sharing one table
+vector<uint32_t> internIdentifiersInParallel(const vector<Token>& tokens, string_view source,
+                                             ConcurrentInterner& interner, unsigned threads)
+{
+    const size_t RANGE_TOKENS = 1 << 16;
+    vector<uint32_t> symbols(tokens.size(), Interner::NONE);
+    size_t ranges = (tokens.size() + RANGE_TOKENS - 1) / RANGE_TOKENS;
+    runWorkStealing(ranges, threads, [&](size_t r) {
+        size_t end = min(tokens.size(), (r + 1) * RANGE_TOKENS);
+        for(size_t i = r * RANGE_TOKENS; i < end; i++)
+        {
+            if(tokens[i].kind == TokenKind::IDENTIFIER)
+                symbols[i] = interner.intern(tokens[i].text(source));
+        }
+    });
+    return symbols;
+}
+
+// 词法分析与语法分析的流水线：词法分析器在自己的线程上运行，
+// 每攒满一批 token 就放进一个无锁的单生产者/单消费者环形队列，语法分析器在调用线程上逐批取用。
+// 批次的存储在队列里循环使用，预热之后两边都不再分配内存；队列满或空时一方先自旋，再让出 CPU。
+
+// Class that runs a LexicalAnalyzer on its own thread and hands its tokens over in batches
+// 对 TokenStream 来说它和 LexicalAnalyzer 一样，是一个提供 nextToken() 的 token 来源
+class TokenPipeline {
+private:
+    static const size_t BATCH_TOKENS = 1024; // 一批 12KB
+    static const size_t RING_BATCHES = 16;
+    static const int SPIN_LIMIT = 64;        // 自旋这么多次还等不到就让出 CPU
+
+    struct TokenBatch {
+        vector<Token> tokens;
+        vector<uint32_t> symbols; // 驻留标识符时与 tokens 一一对应，否则为空
+    };
+
+    SpscRing<TokenBatch> ring;
+    atomic<bool> cancelled;   // 语法分析提前结束时让词法线程退出
+    const TokenBatch* batch;  // 正在读的批次
+    size_t index;             // 批次中下一个 token
+    bool finished;            // 已经读到 END_OF_FILE，之后一直返回 lastToken
+    Token lastToken;
+    bool interns;
+    uint32_t symbol;          // 上一个 token 的符号 ID
+    thread producer;
+
+    // Function to wait until f() returns a slot, nullptr if the pipeline was cancelled
+    template<class F>
+    static TokenBatch* waitFor(F&& f, const atomic<bool>& stop)
+    {
+        for(int spins = 0; ; spins++)
+        {
+            if(TokenBatch* slot = f())
+                return slot;
+            if(stop.load(memory_order_relaxed))
+                return nullptr;
+            if(spins >= SPIN_LIMIT)
+                this_thread::yield();
+        }
+    }
+
+    void produce(string_view source, Interner* interner)
+    {
+        LexicalAnalyzer lexer(source);
+        if(interner != nullptr)
+            lexer.internInto(*interner);
+        bool done = false;
+        while(!done)
+        {
+            TokenBatch* slot = waitFor([&] { return ring.tryBeginWrite(); }, cancelled);
+            if(slot == nullptr)
+                return;
+            slot->tokens.clear();
+            slot->tokens.reserve(BATCH_TOKENS);
+            slot->symbols.clear();
+            while(slot->tokens.size() < BATCH_TOKENS && !done)
+            {
+                slot->tokens.push_back(lexer.nextToken());
+                TokenKind kind = slot->tokens.back().kind;
+                if(interner != nullptr)
+                    slot->symbols.push_back(kind == TokenKind::IDENTIFIER ? lexer.lastSymbol() : Interner::NONE);
+                done = kind == TokenKind::END_OF_FILE;
+            }
+            ring.commitWrite();
+        }
+    }
+
+public:
+    // source 必须比流水线活得久；构造时词法线程就开始工作
+    // 给出 interner 时标识符在词法线程上驻留，符号 ID 随 token 一起交给语法分析；
+    // 词法线程还在写这张表，流水线析构（词法线程结束）之前只能用交过来的 ID，不能读它或往里驻留
+    explicit TokenPipeline(string_view source, Interner* interner = nullptr)
+        : ring(RING_BATCHES)
+        , cancelled(false)
+        , batch(nullptr)
+        , index(0)
+        , finished(false)
+        , lastToken(TokenKind::END_OF_FILE, 0, 0)
+        , interns(interner != nullptr)
+        , symbol(Interner::NONE)
+        , producer([this, source, interner] { produce(source, interner); })
+    {}
+
+    TokenPipeline(const TokenPipeline&) = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    ~TokenPipeline()
+    {
+        cancelled.store(true, memory_order_relaxed);
+        producer.join();
+    }
+
+    // Function to get the next token, END_OF_FILE is returned again once the input is exhausted
+    Token nextToken()
+    {
+        if(finished)
+            return lastToken;
+        if(batch == nullptr || index == batch->tokens.size())
+        {
+            if(batch != nullptr)
+                ring.commitRead();
+            batch = waitFor([&] { return ring.tryBeginRead(); }, cancelled);
+            index = 0;
+        }
+        if(interns)
+            symbol = batch->symbols[index];
+        Token token = batch->tokens[index++];
+        if(token.kind == TokenKind::END_OF_FILE)
+        {
+            finished = true;
+            lastToken = token;
+        }
+        return token;
+    }
+
+    // Function to get the symbol ID of the identifier nextToken() just returned
+    uint32_t lastSymbol() const
+    {
+        return symbol;
+    }
+
+    bool interning() const
+    {
+        return interns;
+    }
+};
+
+// Class that hands tokens to the parser through a small lookahead window
+// 流式模式下窗口由 token 来源（LexicalAnalyzer 或 TokenPipeline）按需批量填充，token 内存与源码大小无关；
+// 也可以在 tokenize() 得到的完整序列上回放：传左值时只借用（不拷贝），传右值时接管其存储
+// 所有访问都返回引用，分析过程中不拷贝也不分配 token
+// token 来源驻留标识符时，窗口旁边还有一列对齐的符号 ID，由 symbol() 读出
+template<class Lexer>
+class BasicTokenStream {
+public:
+    typedef size_t Mark; // token 的绝对下标
+
+private:
+    static const size_t WINDOW_SIZE = 256; // 256 个 token 共 3KB，始终留在 L1 中
+
+    Lexer* lexer;           // 流式模式下的 token 来源，回放模式为空
+    vector<Token> window;   // 流式模式下的缓冲区，或接管过来的完整序列
+    vector<uint32_t> symbols; // 流式模式下 token 来源驻留标识符时与 window 对齐，否则为空
+    const Token* first;     // 当前可访问的第一个 token
+    const Token* cur;       // 当前 token
+    const Token* last;      // 已缓冲 token 的末尾
+    size_t firstIndex;      // first 的绝对下标
+    size_t pinnedIndex;     // 最外层 mark 的绝对下标，窗口不会丢掉它之后的 token
+    size_t markDepth;       // 尚未 reset / release 的 mark 个数
+    bool exhausted;         // 已经取到 END_OF_FILE
+
+    // Function to make at least k+1 tokens available, returns the token at k
+    const Token& fill(size_t k)
+    {
+        if(lexer != nullptr && !exhausted)
+        {
+            // 把还没消费（或被 mark 钉住）的 token 挪到窗口开头，然后继续向后分析
+            size_t keepFrom = markDepth > 0 ? pinnedIndex - firstIndex : size_t(cur - first);
+            size_t curIndex = size_t(cur - first) - keepFrom;
+            size_t kept = size_t(last - first) - keepFrom;
+            if(kept + WINDOW_SIZE > window.size()) // 只有 mark 之后看得很远时才会变大
+            {
+                window.resize(kept + WINDOW_SIZE, Token(TokenKind::END_OF_FILE, 0, 0));
+                if(!symbols.empty())
+                    symbols.resize(window.size(), Interner::NONE);
+            }
+            Token* base = window.data();
+            memmove(static_cast<void*>(base), base + keepFrom, kept * sizeof(Token));
+            if(!symbols.empty())
+                memmove(symbols.data(), symbols.data() + keepFrom, kept * sizeof(uint32_t));
+            Token* out = base + kept;
+            Token* limit = base + window.size();
+            while(out < limit && !exhausted)
+            {
+                *out = lexer->nextToken();
+                if(!symbols.empty())
+                    symbols[out - base] = out->kind == TokenKind::IDENTIFIER ? lexer->lastSymbol() : Interner::NONE;
+                exhausted = out->kind == TokenKind::END_OF_FILE;
+                out++;
+            }
+            firstIndex += keepFrom;
+            first = base;
+            cur = base + curIndex;
+            last = out;
+            if(k < size_t(last - cur))
+                return cur[k];
+        }
+        return last[-1]; // 超出末尾时一直停在 END_OF_FILE 上
+    }
+
+    void replay(const Token* begin, size_t count)
+    {
+        first = cur = begin;
+        last = begin + count;
+    }
+
+public:
+    // 来源要驻留标识符的话，须在构造 stream 之前设好
+    explicit BasicTokenStream(Lexer& source)
+        : lexer(&source)
+        , window(WINDOW_SIZE, Token(TokenKind::END_OF_FILE, 0, 0))
+        , symbols(source.interning() ? WINDOW_SIZE : 0, Interner::NONE)
+        , first(window.data())
+        , cur(window.data())
+        , last(window.data())
+        , firstIndex(0)
+        , pinnedIndex(0)
+        , markDepth(0)
+        , exhausted(false)
+    {}
+
+    // 在已有的 token 序列上回放，序列必须以 END_OF_FILE 结尾且比 stream 活得久
+    BasicTokenStream(const Token* tokens, size_t count)
+        : lexer(nullptr)
+        , firstIndex(0)
+        , pinnedIndex(0)
+        , markDepth(0)
+        , exhausted(true)
+    {
+        replay(tokens, count);
+    }
+
+    explicit BasicTokenStream(const vector<Token>& tokens)
+        : BasicTokenStream(tokens.data(), tokens.size())
+    {}
+
+    // 接管序列的存储，不拷贝
+    explicit BasicTokenStream(vector<Token>&& tokens)
+        : lexer(nullptr)
+        , window(std::move(tokens))
+        , firstIndex(0)
+        , pinnedIndex(0)
+        , markDepth(0)
+        , exhausted(true)
+    {
+        replay(window.data(), window.size());
+    }
+
+    BasicTokenStream(const BasicTokenStream&) = delete;
+    BasicTokenStream& operator=(const BasicTokenStream&) = delete;
+
+    // Function to look k tokens ahead, k must be smaller than the window size
+    const Token& peek(size_t k = 0)
+    {
+        if(k < size_t(last - cur))
+            return cur[k];
+        return fill(k);
+    }
+
+    const Token& current()
+    {
+        return peek();
+    }
+
+    TokenKind peekKind(size_t k = 0)
+    {
+        return peek(k).kind;
+    }
+
+    // Function to get the symbol ID of the current identifier, Interner::NONE when nobody interned it
+    uint32_t symbol()
+    {
+        if(symbols.empty())
+            return Interner::NONE;
+        peek();
+        return symbols[size_t(cur - first)];
+    }
+
+    // Function to move to the next token, staying on END_OF_FILE at the end
+    void advance()
+    {
+        if(peek().kind != TokenKind::END_OF_FILE)
+            cur++;
+    }
+
+    // Function to remember the current position for a later reset()
+    // mark 按后进先出配对 reset() 或 release()；流式模式下被钉住的 token 留在窗口里
+    Mark mark()
+    {
+        Mark m = firstIndex + size_t(cur - first);
+        if(markDepth++ == 0)
+            pinnedIndex = m;
+        return m;
+    }
+
+    // Function to go back to a mark and drop it
+    void reset(Mark m)
+    {
+        cur = first + (m - firstIndex);
+        release(m);
+    }
+
+    // Function to drop a mark without moving
+    void release(Mark)
+    {
+        markDepth--;
+    }
+};
+
+using TokenStream = BasicTokenStream<LexicalAnalyzer>;
+using PipelineTokenStream = BasicTokenStream<TokenPipeline>;
+
+// Class that walks a TokenBuffer (or a mapped TokenCache with the same columns) for the parser
+// peek() 按需从各个数组拼出一个 Token 值，内联后只会读到真正用到的字段
+template<class Tokens>
+class BasicTokenBufferCursor {
+public:
+    typedef size_t Mark;
+
+private:
+    const Tokens* buffer;
+    size_t pos;
+    size_t lastIndex; // END_OF_FILE 的下标
+
+public:
+    // buffer 必须以 END_OF_FILE 结尾且在分析期间保持有效
+    explicit BasicTokenBufferCursor(const Tokens& tokens)
+        : buffer(&tokens)
+        , pos(0)
+        , lastIndex(tokens.size() - 1)
+    {}
+
+    Token peek(size_t k = 0) const
+    {
+        size_t i = min(pos + k, lastIndex);
+        return Token(buffer->kind(i), buffer->offset(i), buffer->length(i));
+    }
+
+    Token current() const
+    {
+        return peek();
+    }
+
+    // 语法分析的绝大多数判断只需要 kind，只读紧凑的 kind 数组
+    TokenKind peekKind(size_t k = 0) const
+    {
+        return buffer->kind(min(pos + k, lastIndex));
+    }
+
+    // Function to get the symbol ID of the current identifier, Interner::NONE when nobody interned it
+    uint32_t symbol() const
+    {
+        return buffer->hasSymbols() ? buffer->symbol(pos) : Interner::NONE;
+    }
+
+    void advance()
+    {
+        if(pos < lastIndex)
+            pos++;
+    }
+
+    Mark mark() const { return pos; }
+    void reset(Mark m) { pos = m; }
+    void release(Mark) {}
+};
+
+using TokenBufferCursor = BasicTokenBufferCursor<TokenBuffer>;
+using TokenCacheCursor = BasicTokenBufferCursor<TokenCache>;
+
+// Class that replays tokens [begin, end) of a complete token vector as if they were the whole input
+// 切片末尾读到的是一个假的 END_OF_FILE；一旦分析看到了它，touchedEnd() 就为真，
+// 说明这一段的分析结果取决于切片之外的 token，不能直接采用。
+// 切片一直到真正的 END_OF_FILE 时，末尾就是那个 token 本身，看到它不算越界
+class TokenSliceCursor {
+public:
+    typedef size_t Mark;
+
+private:
+    const Token* tokens;
+    size_t pos;
+    size_t endIndex;
+    Token sentinel;
+    bool fakeEnd; // 切片末尾不是真正的 END_OF_FILE
+    bool touched;
+
+public:
+    // tokens 必须以 END_OF_FILE 结尾，end 最大为它的下标
+    TokenSliceCursor(const vector<Token>& all, size_t begin, size_t end)
+        : tokens(all.data())
+        , pos(begin)
+        , endIndex(end)
+        , sentinel(TokenKind::END_OF_FILE, all[end].offset, 0)
+        , fakeEnd(all[end].kind != TokenKind::END_OF_FILE)
+        , touched(false)
+    {}
+
+    const Token& peek(size_t k = 0)
+    {
+        if(k < endIndex - pos)
+            return tokens[pos + k];
+        if(fakeEnd)
+            touched = true;
+        return sentinel;
+    }
+
+    const Token& current()
+    {
+        return peek();
+    }
+
+    TokenKind peekKind(size_t k = 0)
+    {
+        return peek(k).kind;
+    }
+
+    // 并行分析只做语法检查，用不到符号 ID
+    uint32_t symbol() const
+    {
+        return Interner::NONE;
+    }
+
+    void advance()
+    {
+        if(pos < endIndex)
+            pos++;
+    }
+
+    Mark mark() const { return pos; }
+    void reset(Mark m) { pos = m; }
+    void release(Mark) {}
+
+    size_t position() const { return pos; }
+    bool atEnd() const { return pos == endIndex; }
+    bool touchedEnd() const { return touched; }
+
+    // Function to continue from another token of the slice
+    void seek(size_t index) { pos = index; }
+};
+
+// Function to write the printed name of a token's type
+// 关键字、运算符、界符打印为带单引号的原文，其余打印固定的名字
+void writeTokenTypeName(OutputBuffer& out, TokenType type, const Token& token, string_view source)
 {
     switch(type)
     {
         case TokenType::KEYWORD:
-            return getKeyWordName(token);
-        case TokenType::IDENTIFIER:
-            return "Ident";
-        case TokenType::INTEGER_LITERAL:
-            return "IntConst";
         case TokenType::OPERATOR:
-            return getOPERATORName(token);
         case TokenType::PUNCTUATOR:
-            return getPunctuatorName(token);
+            out.append('\'');
+            out.append(token.text(source));
+            out.append('\'');
+            return;
+        case TokenType::IDENTIFIER:
+            out.append("Ident");
+            return;
+        case TokenType::INTEGER_LITERAL:
+            out.append("IntConst");
+            return;
         case TokenType::UNKNOWN:
-            return "Unknown";
+            out.append("Unknown");
+            return;
         default:
-            return "UNDEFINED";
+            out.append("UNDEFINED");
+            return;
     }
 }
 
 // Function to print all tokens
-void printTokens(const vector<Token>& tokens)
+// 每行 N:类型:"原文"，格式化进一块大缓冲区，攒满了才 write() 一次，不再每个 token 刷新一次 cout
+void printTokens(const vector<Token>& tokens, string_view source)
 {
-    int count = 0;
+    cout.flush(); // 之前经 cout 输出的内容要排在前面
+    OutputBuffer out(STDOUT_FILENO);
+    size_t count = 0;
     for(const auto& token : tokens)
     {
-        cout << count++ <<":" << getTokenTypeName(token.type, token)
-        <<":"<<"\"" << token.value << "\"" << endl;
+        out.appendUnsigned(count++);
+        out.append(':');
+        writeTokenTypeName(out, token.type, token, source);
+        out.append(":\"");
+        out.append(token.text(source));
+        out.append("\"\n");
     }
 }
 
@@ -317,115 +1013,336 @@ void printTokens(const vector<Token>& tokens)
 ///////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-class SyntaxAnalyzer{
-private:
-    vector<Token> tokens; 
-    int pos; // 当前的位置
-    set<int> errorLines;
+// 二元运算符的结合力，0 表示不是二元运算符；数值越大结合越紧
+enum BindingPower : uint8_t {
+    BINDING_POWER_NONE = 0,
+    BINDING_POWER_LOR  = 1, // ||
+    BINDING_POWER_LAND = 2, // &&
+    BINDING_POWER_REL  = 3, // < <= > >= == !=
+    BINDING_POWER_ADD  = 4, // + -
+    BINDING_POWER_MUL  = 5, // * / %
+    BINDING_POWER_UNARY = 6, // 前缀 + - !，只用作 parseExpr 的下限
+};
+
+struct BindingPowerTable {
+    uint8_t power[256];
+};
 
-    Token getCurrentToken() {
-        if(pos >= tokens.size()) return tokens.back();
-        return tokens[pos];
+constexpr BindingPowerTable buildBindingPowerTable()
+{
+    BindingPowerTable table{};
+    table.power[uint8_t(TokenKind::OP_OR)] = BINDING_POWER_LOR;
+    table.power[uint8_t(TokenKind::OP_AND)] = BINDING_POWER_LAND;
+    for(TokenKind k : {TokenKind::OP_LT, TokenKind::OP_LE, TokenKind::OP_GT,
+                       TokenKind::OP_GE, TokenKind::OP_EQ, TokenKind::OP_NE})
+        table.power[uint8_t(k)] = BINDING_POWER_REL;
+    table.power[uint8_t(TokenKind::OP_PLUS)] = BINDING_POWER_ADD;
+    table.power[uint8_t(TokenKind::OP_MINUS)] = BINDING_POWER_ADD;
+    table.power[uint8_t(TokenKind::OP_MUL)] = BINDING_POWER_MUL;
+    table.power[uint8_t(TokenKind::OP_DIV)] = BINDING_POWER_MUL;
+    table.power[uint8_t(TokenKind::OP_MOD)] = BINDING_POWER_MUL;
+    return table;
+}
+
+inline constexpr BindingPowerTable bindingPowerTable = buildBindingPowerTable();
+
+// Function to get the binding power of a binary operator
+inline uint8_t bindingPowerOf(TokenKind kind)
+{
+    return bindingPowerTable.power[uint8_t(kind)];
+}
+
+// 只有基准测试统计表达式分析的调用次数，平时计数的代码整个不生成
+#ifdef SYNTAX_BENCH
+constexpr bool COUNT_EXPR_CALLS = true;
+#else
+constexpr bool COUNT_EXPR_CALLS = false;
+#endif
+
+// Struct to count the parse-function calls spent on expressions, only kept when COUNT_EXPR_CALLS
+struct ExprCallCounts {
+    size_t calls;    // parseExpr 和 parsePrimaryExpr 实际被调用的次数
+    size_t descent;  // 同样的输入用 parseExpr → LOr → LAnd → Rel → Add → Mul → Unary → Primary 逐层下降要调用的次数
+    size_t operands; // parsePrimaryExpr 被调用的次数
+};
+
+// Struct to represent a FuncDef header found by parseSignatures(), with the token range of its body
+struct FuncSignature {
+    TokenKind returnType; // KW_INT 或 KW_VOID
+    SourceSpan name;
+    uint32_t paramCount;
+    size_t bodyBegin;     // '{' 的 cursor 位置；没有 '{' 时等于 bodyEnd，签名阶段已经报过错
+    size_t bodyEnd;       // 配对的 '}' 之后，或 END_OF_FILE
+};
+
+// Class that implements the syntax analyzer over a token cursor
+// Cursor 需要提供 current()、peek(k)、peekKind(k)、advance() 和 mark()/reset()/release()：
+// TokenStream（流式或回放 vector）、TokenBufferCursor（SoA）、TokenCacheCursor（映射进来的缓存）
+// Builder 决定分析的同时建出什么样的语法树（见 Ast.h），默认的 NullAstBuilder 只做检查
+template<class Cursor, class Builder = NullAstBuilder>
+class BasicSyntaxAnalyzer{
+private:
+    typedef typename Builder::ExprRef ExprRef;
+    typedef typename Builder::StmtRef StmtRef;
+    typedef typename Builder::VarRef VarRef;
+    typedef typename Builder::ParamRef ParamRef;
+    typedef typename Builder::FuncRef FuncRef;
+    typedef typename Builder::UnitRef UnitRef;
+
+    Cursor stream;
+    Diagnostics diagnostics;
+    bool stopped; // 错误个数到了上限，之后的 token 一律当作 END_OF_FILE
+    Builder builder;
+    UnitRef unit;
+    uint32_t prevEnd; // 上一个被消费的 token 的结束偏移，用来计算节点的范围，只在建树时维护
+    DeepStack deepStack; // 递归太深时把后续的分析挪到新的栈上
+    bool deferBodies; // parseSignatures() 期间为真：函数体只按花括号配对跳过
+    vector<FuncSignature> signatures;
+
+    // Struct to represent one FuncDef as parseSignatures() saw it
+    struct DeferredFuncDef {
+        size_t begin;       // 开始分析函数头时的 cursor 位置
+        size_t end;         // 跳过函数体之后的位置
+        size_t errorsBegin; // 函数头的诊断在 headerErrors 里的范围
+        size_t errorsEnd;
+        size_t signature;   // 在 signatures 里的下标，函数头没能分析到函数体时为 NO_SIGNATURE
+    };
+    static constexpr size_t NO_SIGNATURE = SIZE_MAX;
+    vector<DeferredFuncDef> deferred;
+    vector<Diagnostic> headerErrors;
+    size_t unitBegin; // parseSignatures() 开始时的 cursor 位置
+    SemanticChecker* semantics; // 不为空时边分析边做语义检查
+    bool fallsThrough; // 刚分析完的语句是否可能执行到它后面，供语义检查判断缺少 return
+    ExprCallCounts exprCalls; // 只在 COUNT_EXPR_CALLS 时统计
+
+    decltype(auto) getCurrentToken() {
+        return stream.current();
     }
 
-    void advance() {
-        if (pos < tokens.size()) pos ++;
+    TokenKind getCurrentKind() {
+        if(stopped)
+            return TokenKind::END_OF_FILE;
+        return stream.peekKind();
     }
 
-    void error() {
-        int line = getCurrentToken().line;
-        errorLines.insert(line);
+    void advance() {
+        if(stopped)
+            return;
+        if constexpr (Builder::BUILDS_TREE) {
+            const Token& token = getCurrentToken();
+            prevEnd = token.offset + token.length;
+        }
+        stream.advance();
     }
 
-    bool match(TokenType type, const string& value = "") {
-        if(getCurrentToken().type != type) return false;
-        if(!value.empty() && getCurrentToken().value != value) return false;
-        return true;
+    // Function to report a syntax error at the current token, expected is a set of tokenBit()
+    // 只记下位置和错误码，行号等到输出时才查
+    void error(DiagnosticCode code, uint64_t expected) {
+        if(stopped)
+            return;
+        const Token& token = getCurrentToken();
+        Diagnostic record{token.offset, token.kind == TokenKind::END_OF_FILE ? 0 : token.length, expected, code};
+        if(deferBodies)
+            headerErrors.push_back(record);
+        if(!diagnostics.report(record))
+            stopped = true;
     }
 
-    bool consume(TokenType type, const string&value) {
-        if(match(type, value)) {
-            advance();
-            return true;
-        }
-        error();
-        return false;
+    bool match(TokenKind kind) {
+        return getCurrentKind() == kind;
     }
 
-    bool consume(TokenType type) {
-        if(getCurrentToken().type == type) {
+    bool consume(TokenKind kind) {
+        if(match(kind)) {
             advance();
             return true;
         }
-        error();
+        error(DiagnosticCode::EXPECTED_TOKEN, tokenBit(kind));
         return false;
     }
 
     void sync() {
-        while(getCurrentToken().type != TokenType::END_OF_FILE &&
-            !(match(TokenType::PUNCTUATOR, ";"))&&
-            !(match(TokenType::PUNCTUATOR,"}"))) {
+        while(!match(TokenKind::END_OF_FILE) &&
+            !match(TokenKind::P_SEMI) &&
+            !match(TokenKind::P_RBRACE)) {
                 advance();
             }
-            if(match(TokenType::PUNCTUATOR, ";"))
+            if(match(TokenKind::P_SEMI))
                 advance();
     }
 
+    // 不建树时只有签名表和语义检查需要位置，其余情况下返回空的范围，不去读 token
+    SourceSpan currentSpan() {
+        if(Builder::BUILDS_TREE || deferBodies || semantics != nullptr) {
+            const Token& token = getCurrentToken();
+            return SourceSpan{token.offset, token.length};
+        }
+        return SourceSpan{0, 0};
+    }
+
+    // Function to get the symbol ID of the current identifier, Interner::NONE when the lexer did not intern it
+    uint32_t currentSymbol() {
+        if(Builder::BUILDS_TREE || semantics != nullptr)
+            return stream.symbol();
+        return Interner::NONE;
+    }
+
+    uint32_t currentOffset() {
+        if constexpr (Builder::BUILDS_TREE)
+            return getCurrentToken().offset;
+        return 0;
+    }
+
+    size_t position() {
+        size_t m = stream.mark();
+        stream.release(m);
+        return m;
+    }
+
+    // Function to move the cursor back (or forward) to a position already read
+    // 流式窗口做不到，只用于回放 vector<Token>、TokenBufferCursor 这类能随机访问的 cursor
+    void seek(size_t m) {
+        stream.mark();
+        stream.reset(m);
+    }
+
+    // Function to get the span from start to the end of the last consumed token
+    SourceSpan spanFrom(uint32_t start) {
+        return SourceSpan{start, prevEnd > start ? prevEnd - start : 0};
+    }
+
     void parseCompUnit() {
-        while (getCurrentToken().type != TokenType::END_OF_FILE) {
-            parseFuncDef();
+        size_t mark = builder.mark();
+        while (!match(TokenKind::END_OF_FILE)) {
+            builder.push(parseFuncDef());
         }
+        unit = builder.compUnit(mark);
+        if(semantics != nullptr)
+            semantics->endUnit();
     }
 
     // 函数定义 FuncDef → (“int” | “void”) ID “(” (Param (“,” Param)*)? “)” Block
-    void parseFuncDef() {
-        if (!match(TokenType::KEYWORD, "int") && !match(TokenType::KEYWORD, "void")) {
-            error();
+    FuncRef parseFuncDef() {
+        uint32_t start = currentOffset();
+        if (!match(TokenKind::KW_INT) && !match(TokenKind::KW_VOID)) {
+            error(DiagnosticCode::EXPECTED_TOKEN, tokenBit(TokenKind::KW_INT) | tokenBit(TokenKind::KW_VOID));
             sync();
-            if(match(TokenType::PUNCTUATOR,"}"))
+            if(match(TokenKind::P_RBRACE))
                 advance();
-            return;
+            return builder.errorFunc(spanFrom(start));
         }
+        TokenKind returnType = getCurrentKind();
         advance();
 
-        if(!consume(TokenType::IDENTIFIER)) {
+        SourceSpan name = currentSpan();
+        uint32_t symbol = currentSymbol();
+        if(!consume(TokenKind::IDENTIFIER)) {
             sync();
-            if(match(TokenType::PUNCTUATOR,"}"))
+            if(match(TokenKind::P_RBRACE))
                 advance();
-            return;
+            return builder.errorFunc(spanFrom(start));
         }
 
-        consume(TokenType::PUNCTUATOR, "(");
+        consume(TokenKind::P_LPAREN);
+        if(semantics != nullptr)
+            semantics->enterScope(); // 形参和函数体最外层的 Block 共用这个作用域
 
-        if(match(TokenType::KEYWORD, "int")) {
-            parseParam();
-            while(match(TokenType::PUNCTUATOR,",")) {
+        size_t mark = builder.mark();
+        uint32_t paramCount = 0;
+        if(match(TokenKind::KW_INT)) {
+            builder.push(parseParam());
+            paramCount++;
+            while(match(TokenKind::P_COMMA)) {
                 advance();
-                parseParam();
+                builder.push(parseParam());
+                paramCount++;
             }
         }
 
-        consume(TokenType::PUNCTUATOR, ")");
-        parseBlock();
+        consume(TokenKind::P_RPAREN);
+        if(semantics != nullptr)
+            semantics->beginFunc(returnType, name, symbol, paramCount);
+        StmtRef body = deferBodies ? skipBlock(returnType, name, paramCount) : parseBlock(false);
+        if(semantics != nullptr) {
+            semantics->endFunc(name, fallsThrough);
+            semantics->exitScope();
+        }
+        return builder.funcDef(returnType, name, symbol, mark, body);
+    }
+
+    // Function to record a FuncDef header and step over its Block by brace matching
+    // 没有 '{' 时照常交给 parseBlock() 报错，签名阶段的出错行与完整分析时一样
+    StmtRef skipBlock(TokenKind returnType, SourceSpan name, uint32_t paramCount) {
+        size_t begin = position();
+        if(!match(TokenKind::P_LBRACE)) {
+            signatures.push_back(FuncSignature{returnType, name, paramCount, begin, begin});
+            return parseBlock();
+        }
+        size_t depth = 0;
+        do {
+            TokenKind kind = getCurrentKind();
+            if(kind == TokenKind::P_LBRACE)
+                depth++;
+            else if(kind == TokenKind::P_RBRACE)
+                depth--;
+            advance();
+        } while(depth > 0 && !match(TokenKind::END_OF_FILE));
+        signatures.push_back(FuncSignature{returnType, name, paramCount, begin, position()});
+        return builder.noStmt();
     }
 
     // 形参 Param → “int” ID
-    void parseParam(){
-        consume(TokenType::KEYWORD, "int");
-        consume(TokenType::IDENTIFIER);
+    ParamRef parseParam(){
+        uint32_t start = currentOffset();
+        consume(TokenKind::KW_INT);
+        SourceSpan name = currentSpan();
+        uint32_t symbol = currentSymbol();
+        if(!consume(TokenKind::IDENTIFIER))
+            return builder.errorParam(spanFrom(start));
+        if(semantics != nullptr)
+            semantics->declare(name, symbol);
+        return builder.param(name, symbol);
     }
 
     // 语句块 Block → “{” Stmt* “}”
-    void parseBlock() {
-        if (!consume(TokenType::PUNCTUATOR, "{")) {
-            return;
+    // 函数体的 Block 与形参共用一个作用域，这时 opensScope 为 false
+    StmtRef parseBlock(bool opensScope = true) {
+        uint32_t start = currentOffset();
+        if (!consume(TokenKind::P_LBRACE)) {
+            fallsThrough = true;
+            return builder.errorStmt(SourceSpan{start, 0});
         }
-        while (!match(TokenType::PUNCTUATOR,"}") &&
-                getCurrentToken().type != TokenType::END_OF_FILE){
-                    parseStmt();
+        bool scoped = opensScope && semantics != nullptr;
+        if(scoped)
+            semantics->enterScope();
+        size_t mark = builder.mark();
+        bool reachesEnd = true; // 每一条语句都可能执行到下一条
+        while (!match(TokenKind::P_RBRACE) &&
+                !match(TokenKind::END_OF_FILE)){
+                    builder.push(parseStmt());
+                    reachesEnd = reachesEnd && fallsThrough;
                 }
 
-        consume(TokenType::PUNCTUATOR, "}");
+        consume(TokenKind::P_RBRACE);
+        if(scoped)
+            semantics->exitScope();
+        fallsThrough = reachesEnd;
+        return builder.block(spanFrom(start), mark);
+    }
+
+    // Function to parse one declarator ID (“=” Expr)? of a DeclStmt
+    VarRef parseVarDecl() {
+        SourceSpan name = currentSpan();
+        uint32_t symbol = currentSymbol();
+        bool named = consume(TokenKind::IDENTIFIER);
+        ExprRef init = builder.noExpr();
+        if(match(TokenKind::OP_ASSIGN)) {
+            advance();
+            init = parseExpr();
+        }
+        if(named && semantics != nullptr)
+            semantics->declare(name, symbol); // 初始化表达式里的同名变量仍指外层的那个
+        return named ? builder.varDecl(name, symbol, init) : builder.errorVar(spanFrom(name.offset));
     }
 
     /*
@@ -434,212 +1351,704 @@ private:
            | “if ” “(” Expr “)” Stmt (“else” Stmt)?
            | “while” “(” Expr “)” Stmt
            | “break” “;” | “continue” “;” | “return” Expr “;”
+    if / while 的语句体经由这里递归，成千上万层嵌套时由 DeepStack 换到新的栈上继续
     */
-    void parseStmt() {
-        if(match(TokenType::KEYWORD, "int")) {
+    StmtRef parseStmt() {
+        return deepStack.recurse([&] { return parseStmtBody(); });
+    }
+
+    // Function to parse the body of an if or while, which is a scope of its own even when it is not a Block
+    StmtRef parseSubStmt() {
+        if(semantics == nullptr)
+            return parseStmt();
+        semantics->enterScope();
+        StmtRef stmt = parseStmt();
+        semantics->exitScope();
+        return stmt;
+    }
+
+    StmtRef parseStmtBody() {
+        uint32_t start = currentOffset();
+        fallsThrough = true;
+        switch(getCurrentKind()) {
+        case TokenKind::KW_INT: {
             advance();
-            consume(TokenType::IDENTIFIER);
-            if(match(TokenType::OPERATOR,"="))
-            {
-                advance();
-                parseExpr();
-            }
-            while(match(TokenType::PUNCTUATOR,",")) {
+            size_t mark = builder.mark();
+            builder.push(parseVarDecl());
+            while(match(TokenKind::P_COMMA)) {
                 advance();
-                consume(TokenType::IDENTIFIER);
-                if(match(TokenType::OPERATOR,"=")) {
-                    advance();
-                    parseExpr();
-                }
+                builder.push(parseVarDecl());
             }
-            consume(TokenType::PUNCTUATOR, ";");
-        } else if(match(TokenType::KEYWORD, "if")) {
+            consume(TokenKind::P_SEMI);
+            return builder.decl(spanFrom(start), mark);
+        }
+        case TokenKind::KW_IF: {
             advance();
-            consume(TokenType::PUNCTUATOR, "(");
-            parseExpr();
-            consume(TokenType::PUNCTUATOR, ")");
-            parseStmt();
-            if(match(TokenType::KEYWORD, "else")) {
+            consume(TokenKind::P_LPAREN);
+            ExprRef cond = parseExpr();
+            consume(TokenKind::P_RPAREN);
+            StmtRef thenStmt = parseSubStmt();
+            bool thenFallsThrough = fallsThrough;
+            StmtRef elseStmt = builder.noStmt();
+            if(match(TokenKind::KW_ELSE)) {
                 advance();
-                parseStmt();
+                elseStmt = parseSubStmt();
+                fallsThrough = thenFallsThrough || fallsThrough;
+            } else {
+                fallsThrough = true;
             }
-        } else if(match(TokenType::KEYWORD, "while")) {
+            return builder.ifStmt(spanFrom(start), cond, thenStmt, elseStmt);
+        }
+        case TokenKind::KW_WHILE: {
             advance();
-            consume(TokenType::PUNCTUATOR, "(");
-            parseExpr();
-            consume(TokenType::PUNCTUATOR, ")");
-            parseStmt();
-        } else if(match(TokenType::KEYWORD, "break")) {
+            consume(TokenKind::P_LPAREN);
+            ExprRef cond = parseExpr();
+            consume(TokenKind::P_RPAREN);
+            if(semantics != nullptr)
+                semantics->enterLoop();
+            StmtRef body = parseSubStmt();
+            if(semantics != nullptr)
+                semantics->exitLoop();
+            fallsThrough = true; // 不假定循环体会执行
+            return builder.whileStmt(spanFrom(start), cond, body);
+        }
+        case TokenKind::KW_BREAK: {
+            SourceSpan keyword = currentSpan();
             advance();
-            consume(TokenType::PUNCTUATOR, ";");
-        } else if (match(TokenType::KEYWORD, "continue")) {
+            if(semantics != nullptr)
+                semantics->jump(keyword);
+            consume(TokenKind::P_SEMI);
+            fallsThrough = false;
+            return builder.breakStmt(spanFrom(start));
+        }
+        case TokenKind::KW_CONTINUE: {
+            SourceSpan keyword = currentSpan();
             advance();
-            consume(TokenType::PUNCTUATOR, ";");
-        } else if( match(TokenType::KEYWORD, "return")) {
+            if(semantics != nullptr)
+                semantics->jump(keyword);
+            consume(TokenKind::P_SEMI);
+            fallsThrough = false;
+            return builder.continueStmt(spanFrom(start));
+        }
+        case TokenKind::KW_RETURN: {
+            SourceSpan keyword = currentSpan();
             advance();
-            if(!(match(TokenType::PUNCTUATOR, ";"))) {
-                parseExpr();
+            ExprRef value = builder.noExpr();
+            bool hasValue = !match(TokenKind::P_SEMI);
+            if(hasValue) {
+                value = parseExpr();
             }
-            consume(TokenType::PUNCTUATOR, ";");
-        } else if (match(TokenType::PUNCTUATOR, ";") ){
-            parseBlock();
-        } else if(getCurrentToken().type == TokenType::IDENTIFIER) {
+            if(semantics != nullptr)
+                semantics->returnStmt(keyword, hasValue);
+            consume(TokenKind::P_SEMI);
+            fallsThrough = false;
+            return builder.returnStmt(spanFrom(start), value);
+        }
+        case TokenKind::P_SEMI: {
+            // 空语句按 Block 分析，在 ';' 处报缺少 '{'；报完跳过这个 ';'，否则同一处会一直报下去
+            StmtRef stmt = parseBlock();
             advance();
-            if(match(TokenType::OPERATOR,"=")) {
-                advance();
-                parseExpr();
-                consume(TokenType::PUNCTUATOR, ";");
-            } else if(match(TokenType::PUNCTUATOR,"(")) {
+            return stmt;
+        }
+        case TokenKind::IDENTIFIER: {
+            SourceSpan name = currentSpan();
+            uint32_t symbol = currentSymbol();
+            advance();
+            if(match(TokenKind::OP_ASSIGN)) {
+                if(semantics != nullptr)
+                    semantics->use(name, symbol);
                 advance();
-                if(! (match(TokenType::PUNCTUATOR,")"))) {
-                    parseExpr();
-                    while( match(TokenType::PUNCTUATOR,",")){
-                        advance();
-                        parseExpr();
-                    }
-                }
-                consume(TokenType::PUNCTUATOR, ")");
-                consume(TokenType::PUNCTUATOR, ";");
-            } else {
-                consume(TokenType::PUNCTUATOR, ";");
+                ExprRef value = parseExpr();
+                consume(TokenKind::P_SEMI);
+                return builder.assign(spanFrom(start), name, symbol, value);
             }
-        } else if(match(TokenType::PUNCTUATOR, ";")) {
-            advance();
-        } else {
-            error();
+            ExprRef expr = match(TokenKind::P_LPAREN) ? parseCallArgs(name, symbol) : nameExpr(name, symbol);
+            consume(TokenKind::P_SEMI);
+            return builder.exprStmt(spanFrom(start), expr);
+        }
+        default: {
+            SourceSpan bad = currentSpan();
+            error(DiagnosticCode::EXPECTED_STATEMENT, 0);
             advance();
+            return builder.errorStmt(bad);
+        }
         }
     }
 
-    void parseExpr() {
-        parseLOrExpr();
+    /*
+    表达式 Expr → UnaryExpr (BinOp UnaryExpr)*，UnaryExpr → (“+” | “-” | “!”)* PrimaryExpr
+    用优先级爬升代替 LOr → LAnd → Rel → Add → Mul → Unary 的逐层下降：
+    读一个操作数只需要 parseExpr + parsePrimaryExpr 两次调用；二元运算全部左结合，
+    右操作数只吃结合力更强的运算符，接受的语言和报错位置与逐层下降完全相同
+    括号和前缀运算经由这里递归，嵌套过深时同样由 DeepStack 换栈
+    */
+    ExprRef parseExpr(uint8_t minPower = BINDING_POWER_LOR) {
+        return deepStack.recurse([&] { return parseExprBody(minPower); });
     }
 
-    void parseLOrExpr() {
-        parseLAndExpr();
-        while(match(TokenType::OPERATOR, "||")){
-            advance();
-            parseLAndExpr();
+    ExprRef parseExprBody(uint8_t minPower) {
+        if constexpr (COUNT_EXPR_CALLS) {
+            // 逐层下降从 minPower 那一层一直走到 Unary，从头开始时还要加上 parseExpr 本身；
+            // 前缀运算符和 * / % 的操作数 (minPower == UNARY) 只对应一次 Unary
+            exprCalls.calls++;
+            exprCalls.descent += (minPower <= BINDING_POWER_MUL ? BINDING_POWER_MUL + 1 - minPower : 0) + 1
+                                 + (minPower == BINDING_POWER_LOR);
         }
-    }
-
-    void parseLAndExpr() {
-        parseRelExpr();
-        while( getCurrentToken().type == TokenType::OPERATOR && getCurrentToken().value == "&&") 
-        {
+        uint32_t start = currentOffset();
+        ExprRef lhs;
+        if(match(TokenKind::OP_PLUS) || match(TokenKind::OP_MINUS) || match(TokenKind::OP_NOT)) {
+            // 前缀运算符很少连续出现，这里递归一层换取按正确顺序建节点
+            TokenKind op = getCurrentKind();
             advance();
-            parseRelExpr();
+            ExprRef operand = parseExpr(BINDING_POWER_UNARY);
+            lhs = builder.unary(spanFrom(start), op, operand);
+        } else {
+            lhs = parsePrimaryExpr();
         }
-    }
-
-    void parseRelExpr() {
-        parseAddExpr();
-        while(getCurrentToken().type == TokenType::OPERATOR &&
-    (getCurrentToken().value == "<" || getCurrentToken().value == "<=" || getCurrentToken().value == ">" || getCurrentToken().value == ">=" || getCurrentToken().value == "=="|| getCurrentToken().value == "!="))
-        {
+        if(minPower > BINDING_POWER_MUL)
+            return lhs; // 一元运算的操作数不接二元运算符
+        uint8_t power;
+        while((power = bindingPowerOf(getCurrentKind())) >= minPower) {
+            TokenKind op = getCurrentKind();
             advance();
-            parseAddExpr();
+            ExprRef rhs = parseExpr(power + 1);
+            lhs = builder.binary(spanFrom(start), op, lhs, rhs);
         }
+        return lhs;
     }
 
-    void parseAddExpr() {
-        parseMulExpr();
-        while(getCurrentToken().type == TokenType::OPERATOR && (getCurrentToken().value == "+" || getCurrentToken().value == "-")) {
-            advance();
-            parseMulExpr();
+    // Function to parse “(” (Expr (“,” Expr)*)? “)” after the callee name
+    ExprRef parseCallArgs(SourceSpan callee, uint32_t symbol) {
+        advance();
+        size_t mark = builder.mark();
+        uint32_t argCount = 0;
+        if(!match(TokenKind::P_RPAREN)){
+            builder.push(parseExpr());
+            argCount++;
+            while(match(TokenKind::P_COMMA))
+            {
+                advance();
+                builder.push(parseExpr());
+                argCount++;
+            }
         }
+        consume(TokenKind::P_RPAREN);
+        if(semantics != nullptr)
+            semantics->call(callee, symbol, argCount);
+        return builder.call(spanFrom(callee.offset), callee, symbol, mark);
     }
 
-    void parseMulExpr() {
-        parseUnaryExpr();
-        while(getCurrentToken().type == TokenType::OPERATOR &&
-    (getCurrentToken().value == "*" || getCurrentToken().value == "/" || getCurrentToken().value == "%"))
-    {
-        advance();
-        parseUnaryExpr();
-    }
+    // Function to make the node of a variable that is read
+    ExprRef nameExpr(SourceSpan name, uint32_t symbol) {
+        if(semantics != nullptr)
+            semantics->use(name, symbol);
+        return builder.name(name, symbol);
     }
 
-    void parseUnaryExpr() {
-        if(match(TokenType::OPERATOR, "+") || match(TokenType::OPERATOR, "-") || match(TokenType::OPERATOR, "!"))
-        {
-            advance();
-            parseUnaryExpr();
-        } else {
-            parsePrimaryExpr();
+    ExprRef parsePrimaryExpr() {
+        if constexpr (COUNT_EXPR_CALLS) {
+            exprCalls.calls++;
+            exprCalls.descent++;
+            exprCalls.operands++;
         }
-    }
-
-    void parsePrimaryExpr() {
-        if(match(TokenType::IDENTIFIER))
-        {
+        switch(getCurrentKind()) {
+        case TokenKind::IDENTIFIER: {
+            SourceSpan name = currentSpan();
+            uint32_t symbol = currentSymbol();
             advance();
-            if(match(TokenType::PUNCTUATOR, "("))
-            {
-                advance();
-                if(!match(TokenType::PUNCTUATOR, ")")){
-                    parseExpr();
-                    while(match(TokenType::PUNCTUATOR, ","))
-                    {
-                        advance();
-                        parseExpr();
-                    }
-                }
-                consume(TokenType::PUNCTUATOR, ")");
-            }
+            if(match(TokenKind::P_LPAREN))
+                return parseCallArgs(name, symbol);
+            return nameExpr(name, symbol);
         }
-        else if(match(TokenType::INTEGER_LITERAL))
-        {
+        case TokenKind::INTEGER_LITERAL: {
+            SourceSpan literal = currentSpan();
             advance();
+            return builder.intLiteral(literal);
         }
-        else if (match(TokenType::PUNCTUATOR, "("))
-        {
+        case TokenKind::P_LPAREN: {
             advance();
-            parseExpr();
-            consume(TokenType::PUNCTUATOR, ")");
+            ExprRef inner = parseExpr();
+            consume(TokenKind::P_RPAREN);
+            return inner;
         }
-        else 
-        {
-            error();
-            if(!match(TokenType::END_OF_FILE) && !match(TokenType::PUNCTUATOR, ";")) {
+        default: {
+            SourceSpan bad = currentSpan();
+            error(DiagnosticCode::EXPECTED_EXPRESSION, 0);
+            if(!match(TokenKind::END_OF_FILE) && !match(TokenKind::P_SEMI)) {
                 advance();
             }
+            return builder.errorExpr(bad);
+        }
         }
     }
 
 public:
-    SyntaxAnalyzer(const vector<Token>&toks): tokens(toks), pos(0) {}
+    // source 是 Cursor 的构造参数：LexicalAnalyzer（边分析边取）、vector<Token> 或 TokenBuffer，
+    // 以左值传入的序列需要在分析期间保持有效，vector<Token> 右值则被接管；
+    // 第二个参数是 token 偏移所指的源码；诊断只记偏移，行号到输出时才由 LineIndex 查，分析器本身不再用它
+    template<class Source>
+    BasicSyntaxAnalyzer(Source&& source, string_view /*text*/, Builder treeBuilder = Builder())
+        : stream(std::forward<Source>(source))
+        , diagnostics()
+        , stopped(false)
+        , builder(std::move(treeBuilder))
+        , unit()
+        , prevEnd(0)
+        , deferBodies(false)
+        , unitBegin(0)
+        , semantics(nullptr)
+        , fallsThrough(true)
+        , exprCalls{0, 0, 0}
+    {}
 
     bool parse() {
         parseCompUnit();
-        return errorLines.empty();
+        return diagnostics.empty();
+    }
+
+    // 语法错误按出现的顺序追加，还没有排序去重，见 Diagnostics::finish()
+    Diagnostics& getDiagnostics() {return diagnostics;}
+
+    // 表达式分析的调用次数，只在定义了 SYNTAX_BENCH 时统计，否则全为 0
+    const ExprCallCounts& getExprCalls() const {return exprCalls;}
+
+    // Function to run the checks of checker while parsing, its diagnostics are kept apart from the syntax errors
+    // 只用于从头到尾顺序分析的 parse()，不用于 parseSignatures() 和并行分析
+    void checkSemantics(SemanticChecker& checker) {semantics = &checker;}
+
+    // 下面几个是延迟分析函数体：parseSignatures() 只分析函数头，函数体按花括号配对跳过并记下范围，
+    // 之后可以用 parseBody() 单独分析某一个，或用 parseBodies() 补完整个检查。
+    // 需要 cursor 能回到读过的位置（回放 vector<Token>、TokenBufferCursor、TokenCacheCursor），且不建树
+
+    // Function to parse only the FuncDef headers, false if a header has a syntax error
+    bool parseSignatures() {
+        static_assert(!Builder::BUILDS_TREE, "bodies can only be deferred when checking");
+        unitBegin = position();
+        deferBodies = true;
+        while(!match(TokenKind::END_OF_FILE)) {
+            DeferredFuncDef func{position(), 0, headerErrors.size(), 0, NO_SIGNATURE};
+            size_t count = signatures.size();
+            parseFuncDef();
+            func.end = position();
+            func.errorsEnd = headerErrors.size();
+            if(signatures.size() > count)
+                func.signature = count;
+            deferred.push_back(func);
+        }
+        deferBodies = false;
+        return diagnostics.empty();
+    }
+
+    const vector<FuncSignature>& getSignatures() const {return signatures;}
+
+    // Function to parse the deferred body of signatures[i], false if parsing did not stop at its closing brace
+    // 错误恢复可能跳过一个 '{'，这时语法分析和花括号配对对函数体在哪里结束的看法不同
+    bool parseBody(size_t i) {
+        const FuncSignature& signature = signatures[i];
+        if(signature.bodyBegin == signature.bodyEnd)
+            return true;
+        seek(signature.bodyBegin);
+        parseBlock();
+        return position() == signature.bodyEnd;
     }
 
-    set<int> getErrors() {return errorLines;}
+    // Function to finish a full check after parseSignatures(), the errors are exactly those of parse()
+    // 从同一位置开始分析函数头，结果总是一样的，所以顺序分析走到签名阶段某个 FuncDef 的起点时，
+    // 可以直接采用那时函数头的出错行，再分析它的函数体；函数体恰好停在配对的 '}' 之后就跳到下一个。
+    // 没停在那里时，从实际停下的地方逐个 FuncDef 顺序分析，直到又走回某个记录过的起点。
+    // 这之后 getSignatures() 仍是签名阶段的结果；诊断个数的上限在这一步才起作用，签名阶段最好不设
+    bool parseBodies() {
+        diagnostics.clear();
+        stopped = false;
+        size_t pos = unitBegin;
+        size_t next = 0; // 第一个起点不在 pos 之前的 FuncDef
+        while(!stopped) {
+            while(next < deferred.size() && deferred[next].begin < pos)
+                next++;
+            if(next < deferred.size() && deferred[next].begin == pos) {
+                const DeferredFuncDef& func = deferred[next];
+                for(size_t k = func.errorsBegin; k < func.errorsEnd && !stopped; k++)
+                    stopped = !diagnostics.report(headerErrors[k]);
+                pos = func.signature == NO_SIGNATURE || parseBody(func.signature) ? func.end : position();
+                continue;
+            }
+            seek(pos);
+            if(match(TokenKind::END_OF_FILE))
+                break;
+            parseFuncDef();
+            pos = position();
+        }
+        return diagnostics.empty();
+    }
+
+    // 下面几个供并行分析使用：CompUnit 被切成若干段，每段由一个分析器逐个分析 FuncDef
+
+    // Function to parse one FuncDef at the cursor, the same step parseCompUnit() repeats
+    void parseNextFuncDef() {builder.push(parseFuncDef());}
+
+    Cursor& cursor() {return stream;}
+
+    // Function to get the tree built by parse()
+    UnitRef getAst() {return unit;}
 };
 
+using SyntaxAnalyzer = BasicSyntaxAnalyzer<TokenStream>;
+using SoASyntaxAnalyzer = BasicSyntaxAnalyzer<TokenBufferCursor>;
+using CachedSyntaxAnalyzer = BasicSyntaxAnalyzer<TokenCacheCursor>;
+using AstSyntaxAnalyzer = BasicSyntaxAnalyzer<TokenStream, ArenaAstBuilder>;
+using FlatAstSyntaxAnalyzer = BasicSyntaxAnalyzer<TokenStream, FlatAstBuilder>;
+using SliceSyntaxAnalyzer = BasicSyntaxAnalyzer<TokenSliceCursor>;
+using PipelineSyntaxAnalyzer = BasicSyntaxAnalyzer<PipelineTokenStream>;
+
+// 并行语法分析：CompUnit 只是一串 FuncDef，先按花括号深度找出顶层函数的边界，
+// 把 token 序列切成若干段，在线程池上各自分析，再按顺序合并各段的出错行号。
+// 分析一个 FuncDef 只取决于它读到的 token，所以一段只要在没看到段尾之外的情况下
+// 恰好停在段尾，它的结果就和顺序分析完全相同；看到了段尾（括号错乱、错误恢复越界）的段作废，
+// 合并时从那里顺序分析，每分析完一个 FuncDef 都检查是否回到了某个可用的段首，回到了就继续采用并行结果。
+// 括号根本不配对时预扫描给不出边界，整个文件直接顺序分析。
+// 报告次数到了 Diagnostics::MAX_REPORTS 而停下的段作废；采用一段会让累计的次数到上限时也不采用，
+// 改为顺序分析它，顺序分析停在哪里，合并就停在哪里。
+
+// Function to find the token index after each top-level FuncDef by brace depth
+// 返回的下标递增，最后一个总是 END_OF_FILE 的下标；出现多余的 '}' 或结尾还有未闭合的 '{' 时返回空
+vector<size_t> findFuncDefBoundaries(const vector<Token>& tokens)
+{
+    vector<size_t> boundaries;
+    size_t last = tokens.size() - 1;
+    long depth = 0;
+    for(size_t i = 0; i < last; i++)
+    {
+        TokenKind kind = tokens[i].kind;
+        if(kind == TokenKind::P_LBRACE)
+            depth++;
+        else if(kind == TokenKind::P_RBRACE)
+        {
+            if(--depth < 0)
+                return vector<size_t>();
+            if(depth == 0)
+                boundaries.push_back(i + 1);
+        }
+    }
+    if(depth != 0)
+        return vector<size_t>();
+    if(boundaries.empty() || boundaries.back() != last)
+        boundaries.push_back(last);
+    return boundaries;
+}
 
-int main()
+// Function to check a complete token sequence using several threads
+// 结果经 Diagnostics::finish() 后与 SyntaxAnalyzer 对同一序列 parse() 得到的诊断完全相同
+Diagnostics parseInParallel(const vector<Token>& tokens, string_view text, unsigned threads)
 {
-    string input, line;
-    while(getline(cin, line)) {
-        input += line + "\n";
+    const size_t MIN_SLICE_TOKENS = 4096; // 太小的段不值得一次调度
+    vector<size_t> boundaries = findFuncDefBoundaries(tokens);
+    if(threads <= 1 || boundaries.size() <= 1)
+    {
+        SyntaxAnalyzer parser(tokens, text);
+        parser.parse();
+        return std::move(parser.getDiagnostics());
     }
 
+    // 把相邻的函数合成大小相近的段，段数是线程数的若干倍，留给工作窃取去平衡
+    size_t last = tokens.size() - 1;
+    size_t target = max(MIN_SLICE_TOKENS, last / (size_t(threads) * 8) + 1);
+    vector<size_t> starts(1, 0); // 第 i 段是 [starts[i], starts[i + 1])
+    for(size_t boundary : boundaries)
+    {
+        if(boundary - starts.back() >= target || boundary == last)
+            starts.push_back(boundary);
+    }
+    size_t sliceCount = starts.size() - 1;
+
+    struct SliceResult {
+        Diagnostics diagnostics;
+        bool usable;
+    };
+    vector<SliceResult> results(sliceCount);
+    runWorkStealing(sliceCount, threads, [&](size_t i) {
+        SliceSyntaxAnalyzer parser(TokenSliceCursor(tokens, starts[i], starts[i + 1]), text);
+        TokenSliceCursor& cursor = parser.cursor();
+        while(!cursor.atEnd() && !cursor.touchedEnd() && !parser.getDiagnostics().full())
+            parser.parseNextFuncDef();
+        results[i].usable = !cursor.touchedEnd() && !parser.getDiagnostics().full();
+        results[i].diagnostics = std::move(parser.getDiagnostics());
+    });
+
+    // 采用的段直接并进顺序分析器的诊断里，报告次数一路累计，和顺序分析在同一处停下
+    SliceSyntaxAnalyzer sequential(TokenSliceCursor(tokens, 0, last), text);
+    Diagnostics& diagnostics = sequential.getDiagnostics();
+    size_t pos = 0;
+    size_t next = 0; // 第一个段首不在 pos 之前的段
+    while(pos < last && !diagnostics.full())
+    {
+        while(next < sliceCount && starts[next] < pos)
+            next++;
+        if(next < sliceCount && starts[next] == pos && results[next].usable
+           && !diagnostics.fillsUp(results[next].diagnostics))
+        {
+            diagnostics.append(results[next].diagnostics);
+            pos = starts[next + 1];
+            continue;
+        }
+        sequential.cursor().seek(pos);
+        sequential.parseNextFuncDef();
+        pos = sequential.cursor().position();
+    }
+    return std::move(diagnostics);
+}
+
+
+#ifdef SYNTAX_BENCH
+#include "Benchmark.h"
+#else
+// usage: SyntaxAnalyzer [--dump-ast | --write-ast out | --threads N | --pipeline | --cache tokens | --signatures | --defer-bodies]
+//                       [--sema] [--emit-ir] [--max-errors N] [--messages] [--intern-stats] [file]
+// --signatures 不做检查，每个函数打印一行“返回类型 名字(形参个数)”
+// --defer-bodies 先只分析函数头、再补分析函数体（parseSignatures() + parseBodies()），输出与一遍分析相同
+// --sema 分析的同时做语义检查（见 SemanticChecker.h），语法正确时语义错误同样按行号报告
+// --emit-ir 建树并做语义检查，都通过时打印 accept 和三地址中间表示（见 Ir.h）
+// --max-errors N 报告了 N 个出错位置后停止分析；--messages 不只输出行号，每个错误输出一条带源码摘录的消息
+// 第一行的几种方式和 --emit-ir 只能选一种（--dump-ast 与 --emit-ir 可以同用）；给出所选方式用不上的选项时报错退出
+int main(int argc, char* argv[])
+{
+    const char* fileName = nullptr;
+    bool dumpAst = false;             // 通过分析后打印语法树
+    const char* astOutput = nullptr;  // 通过分析后把扁平语法树写到这个文件
+    bool pipeline = false;            // 词法分析放到单独的线程上，与语法分析流水进行
+    unsigned threads = 1;             // 大于 1 时并行词法分析，再按函数定义切分并行检查（只检查、不建树）
+    bool internStats = false;         // 驻留所有标识符，在标准错误上报告出现次数和不同名字的个数
+    const char* cachePath = nullptr;  // token 缓存文件：与源码对得上就跳过词法分析，否则分析后写出
+    bool signaturesOnly = false;      // 只分析函数头，函数体按花括号配对跳过
+    bool deferBodies = false;         // 函数头和函数体分两步检查，结果应与一遍分析完全相同
+    bool sema = false;                // 分析的同时做语义检查，语法正确时才报告
+    bool emitIr = false;              // 通过分析和语义检查后打印中间表示
+    size_t maxErrors = 0;             // 最多报告多少个出错位置，0 表示不限
+    bool messages = false;            // 输出带源码摘录的错误消息，而不只是行号
+    for(int i = 1; i < argc; i++)
+    {
+        string_view arg = argv[i];
+        if(arg == "--dump-ast")
+            dumpAst = true;
+        else if(arg == "--write-ast" && i + 1 < argc)
+            astOutput = argv[++i];
+        else if(arg == "--intern-stats")
+            internStats = true;
+        else if(arg == "--cache" && i + 1 < argc)
+            cachePath = argv[++i];
+        else if(arg == "--sema")
+            sema = true;
+        else if(arg == "--emit-ir")
+            emitIr = sema = true; // 只翻译语义正确的程序
+        else if(arg == "--max-errors" && i + 1 < argc)
+            maxErrors = size_t(strtoull(argv[++i], nullptr, 10));
+        else if(arg == "--messages")
+            messages = true;
+        else if(arg == "--signatures")
+            signaturesOnly = true;
+        else if(arg == "--defer-bodies")
+            deferBodies = true;
+        else if(arg == "--pipeline")
+            pipeline = true;
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = unsigned(strtoul(argv[++i], nullptr, 10));
+        else
+            fileName = argv[i];
+    }
+    // 下面几种分析方式各走一条路，同时给出时只会用到其中一种，所以报错退出而不是悄悄忽略其余的
+    const pair<bool, const char*> modes[] = {
+        {dumpAst || emitIr, dumpAst ? "--dump-ast" : "--emit-ir"}, {astOutput != nullptr, "--write-ast"},
+        {pipeline, "--pipeline"}, {signaturesOnly, "--signatures"}, {deferBodies, "--defer-bodies"},
+        {cachePath != nullptr, "--cache"}, {threads > 1, "--threads"}};
+    const char* mode = nullptr;
+    for(auto [given, name] : modes)
+    {
+        if(!given)
+            continue;
+        if(mode != nullptr)
+        {
+            cerr << mode << " cannot be combined with " << name << endl;
+            return 1;
+        }
+        mode = name;
+    }
+    // 语义检查随顺序分析进行：各段并行分析、函数体延后分析、只看函数头时都做不了
+    if(sema && (threads > 1 || deferBodies || signaturesOnly))
+    {
+        cerr << mode << " cannot be combined with --sema" << endl;
+        return 1;
+    }
+    // 只打印签名时不报告错误，也不统计标识符
+    if(signaturesOnly && (maxErrors != 0 || messages || internStats))
+    {
+        cerr << "--signatures cannot be combined with "
+             << (maxErrors != 0 ? "--max-errors" : messages ? "--messages" : "--intern-stats") << endl;
+        return 1;
+    }
+
+    // 给出文件参数时直接映射该文件，否则读取标准输入
+    SourceBuffer source;
+    const char* inputName = fileName != nullptr ? fileName : "<stdin>";
+    if(!(fileName != nullptr ? source.open(fileName) : source.loadStdin()))
+    {
+        cerr << "cannot read " << inputName << endl;
+        return 1;
+    }
+    source.ensureTrailingNewline(); // 行号与逐行读入时一致
+    string_view input = source.view();
+
+    if(input.length() > UINT32_MAX) // token 只记录 32 位偏移
+    {
+        cerr << "source file too large" << endl;
+        return 1;
+    }
+
+    // 只有要输出语法树时才建树，平时只做检查
     LexicalAnalyzer lexer(input);
-    vector<Token> tokens = lexer.tokenize();
+    Interner interner;
+    InternerStats symbolStats = {0, 0, 0, 0};
+    if(internStats || sema) // 语义检查和中间表示直接用词法分析给的符号 ID
+        lexer.internInto(interner);
+    Diagnostics diagnostics;
+    AstArena arena;
+    CompUnit* unit = nullptr;
+    FlatAst flat;
+    SemanticChecker checker(input, interner);
+    // Function to parse with whichever analyzer the options chose
+    auto run = [&](auto& parser) {
+        if(sema)
+            parser.checkSemantics(checker);
+        parser.getDiagnostics().setLimit(maxErrors);
+        parser.parse();
+        diagnostics = std::move(parser.getDiagnostics());
+    };
+    if(dumpAst || emitIr)
+    {
+        AstSyntaxAnalyzer parser(lexer, input, ArenaAstBuilder(arena));
+        run(parser);
+        unit = parser.getAst();
+    }
+    else if(astOutput != nullptr)
+    {
+        FlatAstSyntaxAnalyzer parser(lexer, input, FlatAstBuilder(flat));
+        run(parser);
+    }
+    else if(pipeline)
+    {
+        TokenPipeline tokens(input, internStats || sema ? &interner : nullptr);
+        PipelineSyntaxAnalyzer parser(tokens, input);
+        run(parser);
+    }
+    else if(signaturesOnly)
+    {
+        TokenBuffer tokens;
+        lexer.tokenize(tokens);
+        SoASyntaxAnalyzer parser(tokens, input);
+        parser.parseSignatures();
+        cout.flush();
+        OutputBuffer out(STDOUT_FILENO);
+        for(const FuncSignature& signature : parser.getSignatures())
+        {
+            out.append(signature.returnType == TokenKind::KW_INT ? "int " : "void ");
+            out.append(signature.name.text(input));
+            out.append('(');
+            out.appendUnsigned(signature.paramCount);
+            out.append(")\n");
+        }
+        return 0;
+    }
+    else if(deferBodies)
+    {
+        TokenBuffer tokens;
+        lexer.tokenize(tokens);
+        SoASyntaxAnalyzer parser(tokens, input);
+        parser.parseSignatures();
+        parser.getDiagnostics().setLimit(maxErrors);
+        parser.parseBodies();
+        diagnostics = std::move(parser.getDiagnostics());
+    }
+    else if(cachePath != nullptr)
+    {
+        TokenCache cache;
+        if(cache.open(cachePath, input))
+        {
+            vector<uint32_t> symbols; // 缓存里没有符号 ID，需要时另外驻留一遍
+            if(internStats || sema)
+            {
+                symbols = internIdentifiers(cache, input, interner);
+                cache.useSymbols(symbols);
+            }
+            CachedSyntaxAnalyzer parser(cache, input);
+            run(parser);
+        }
+        else
+        {
+            TokenBuffer tokens;
+            lexer.tokenize(tokens);
+            if(!TokenCache::write(cachePath, tokens, input))
+                cerr << "cannot write " << cachePath << endl; // 只是下次不能复用，本次照常分析
+            SoASyntaxAnalyzer parser(tokens, input);
+            run(parser);
+        }
+    }
+    else if(threads > 1)
+    {
+        vector<Token> tokens = tokenizeInParallel(input, threads);
+        if(internStats)
+        {
+            ConcurrentInterner shared;
+            internIdentifiersInParallel(tokens, input, shared, threads);
+            symbolStats = shared.stats();
+        }
+        diagnostics = parseInParallel(tokens, input, threads);
+    }
+    else
+    {
+        SyntaxAnalyzer parser(lexer, input);
+        run(parser);
+    }
+    if(diagnostics.empty()) // 有语法错误时语义检查的结果没有意义
+        diagnostics.append(checker.getDiagnostics());
+    diagnostics.setLimit(maxErrors);
+    diagnostics.finish();
 
-    SyntaxAnalyzer parser(tokens);
-    parser.parse();
-    set<int> Errors = parser.getErrors();
+    if(internStats)
+    {
+        if(interner.size() > 0)
+            symbolStats = interner.stats();
+        fprintf(stderr, "identifiers: %zu occurrences, %zu unique, names %zu bytes, tables %zu bytes\n",
+                symbolStats.occurrences, symbolStats.unique, symbolStats.nameBytes, symbolStats.tableBytes);
+    }
 
-    if(Errors.empty()){
+    if(diagnostics.empty()){
         cout<<"accept" <<endl;
-    } else {
-        cout << "reject" <<endl;
-        for (const auto& e : Errors) {
-            cout << e << endl;
+        if(dumpAst)
+            AstPrinter(cout, input).print(unit);
+        if(emitIr)
+        {
+            IrGenerator generator(input, interner);
+            IrModule ir = generator.generate(unit);
+            IrPrinter(cout, input).print(ir);
         }
+        if(astOutput != nullptr)
+        {
+            int fd = ::open(astOutput, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0 || !flat.writeTo(fd))
+            {
+                cerr << "cannot write " << astOutput << endl;
+                return 1;
+            }
+            ::close(fd);
+        }
+    } else {
+        LineIndex lines(input); // 只为要输出的错误查行号
+        if(messages)
+            diagnostics.renderMessages(cout, inputName, input, lines);
+        else
+            diagnostics.renderLines(cout, lines);
+        if(diagnostics.full()) // 到了 --max-errors 或 MAX_REPORTS，分析在最后一个报告的位置停下
+            cerr << inputName << ": error limit reached, nothing after line "
+                 << lines.lineOf((diagnostics.end() - 1)->offset) << " is reported" << endl;
     }
     return 0;
 }
+#endif
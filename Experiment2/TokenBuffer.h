@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../Common/TokenKind.h"
+
+// Struct-of-arrays token storage
+// kind / offset / length 分开存放（1 + 4 + 2 字节），语法分析做 kind 判断时只扫一段紧凑的字节数组
+// 行号不存，需要时由 offset 经 LineIndex 查出
+// 词法分析时驻留了标识符的话，还有一列符号 ID（不是标识符的 token 为 UINT32_MAX）
+class TokenBuffer {
+public:
+    static const uint16_t LONG_LENGTH = 0xFFFF; // 长度放不进 16 位时的标记，真实长度在 longLengths 里
+
+private:
+    std::vector<TokenKind> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint16_t> lengths;
+    std::vector<uint32_t> symbols; // 没有驻留时为空
+    std::unordered_map<uint32_t, uint32_t> longLengths; // token 下标 -> 长度
+
+public:
+    void reserve(size_t n)
+    {
+        kinds.reserve(n);
+        offsets.reserve(n);
+        lengths.reserve(n);
+    }
+
+    void clear()
+    {
+        kinds.clear();
+        offsets.clear();
+        lengths.clear();
+        symbols.clear();
+        longLengths.clear();
+    }
+
+    void push(TokenKind kind, uint32_t offset, uint32_t length)
+    {
+        if(length >= LONG_LENGTH)
+        {
+            longLengths[uint32_t(kinds.size())] = length;
+            length = LONG_LENGTH;
+        }
+        kinds.push_back(kind);
+        offsets.push_back(offset);
+        lengths.push_back(uint16_t(length));
+    }
+
+    // Function to append a token together with its symbol ID
+    void push(TokenKind kind, uint32_t offset, uint32_t length, uint32_t symbol)
+    {
+        push(kind, offset, length);
+        symbols.push_back(symbol);
+    }
+
+    size_t size() const { return kinds.size(); }
+    bool hasSymbols() const { return !symbols.empty(); }
+    uint32_t symbol(size_t i) const { return symbols[i]; }
+
+    TokenKind kind(size_t i) const { return kinds[i]; }
+    uint32_t offset(size_t i) const { return offsets[i]; }
+
+    uint32_t length(size_t i) const
+    {
+        uint16_t len = lengths[i];
+        if(len == LONG_LENGTH)
+            return longLengths.find(uint32_t(i))->second;
+        return len;
+    }
+
+    // 直接访问各列，用于整块写出
+    const TokenKind* kindData() const { return kinds.data(); }
+    const uint32_t* offsetData() const { return offsets.data(); }
+    const uint16_t* lengthData() const { return lengths.data(); }
+
+    // Function to get the (token index, length) pairs of the long tokens, sorted by index
+    std::vector<std::pair<uint32_t, uint32_t>> sortedLongLengths() const
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> out(longLengths.begin(), longLengths.end());
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    // Function to get the bytes actually used by the arrays
+    size_t memoryUsage() const
+    {
+        return size() * (sizeof(TokenKind) + sizeof(uint32_t) + sizeof(uint16_t))
+               + symbols.size() * sizeof(uint32_t);
+    }
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "../Common/TokenKind.h"
+#include "TokenBuffer.h"
+
+// 二进制 token 缓存：把 TokenBuffer 的几列原样写进文件，下次对同一份源码分析时直接 mmap 进来，
+// 不再做词法分析。文件头记录源码的长度和哈希，源码变了缓存就作废。
+//
+//   TokenCacheHeader
+//   kinds      uint8  * tokenCount，补齐到 4 字节
+//   offsets    uint32 * tokenCount
+//   lengths    uint16 * tokenCount，补齐到 8 字节；0xFFFF 表示真实长度在下面的表里
+//   long       {uint32 下标, uint32 长度} * longCount，按下标递增
+//
+// 行号不存，和 TokenBuffer 一样由偏移经 LineIndex 查出。整数按本机字节序存放，缓存只在本机复用。
+
+// Struct to represent the header in front of the cached arrays
+struct TokenCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint64_t tokenCount;
+    uint64_t longCount;
+};
+
+struct TokenCacheLongLength {
+    uint32_t index;
+    uint32_t length;
+};
+
+// Function to hash the whole source text, 32 bytes per step in four independent lanes
+inline uint64_t hashSource(std::string_view text)
+{
+    const uint64_t K = 0x9E3779B97F4A7C15ull;
+    uint64_t lanes[4] = {K, K * 3, K * 5, K * 7};
+    const char* p = text.data();
+    size_t n = text.size();
+    for(; n >= 32; p += 32, n -= 32)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            uint64_t word;
+            std::memcpy(&word, p + i * 8, 8);
+            lanes[i] = (lanes[i] ^ word) * 0xFF51AFD7ED558CCDull;
+            lanes[i] ^= lanes[i] >> 31;
+        }
+    }
+    uint64_t h = text.size();
+    for(int i = 0; i < 4; i++)
+        h = (h ^ lanes[i]) * K;
+    for(; n > 0; p++, n--)
+        h = (h ^ uint8_t(*p)) * 0x100000001B3ull;
+    h ^= h >> 29;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 32);
+}
+
+// Class that maps a token cache file and reads it like a TokenBuffer
+class TokenCache {
+private:
+    void* mapped;
+    size_t mappedSize;
+    const TokenKind* kinds;
+    const uint32_t* offsets;
+    const uint16_t* lengths;
+    const TokenCacheLongLength* longLengths;
+    const std::vector<uint32_t>* symbols; // 由 useSymbols() 借来，没有时为空
+    size_t count;
+    size_t longCount;
+
+    static size_t alignUp(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+    // Function to check that every token stays inside the source and has a known kind
+    // 文件头完好不代表内容完好：截断或损坏的数组会让 text() 读到源码映射之外
+    bool tokensInBounds(size_t sourceSize) const
+    {
+        size_t markers = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            if(uint8_t(kinds[i]) > uint8_t(TokenKind::END_OF_FILE) || offsets[i] > sourceSize)
+                return false;
+            if(lengths[i] == TokenBuffer::LONG_LENGTH)
+                markers++;
+            else if(sourceSize - offsets[i] < lengths[i])
+                return false;
+        }
+        // 长度表按下标严格递增、每项都对应一个 LONG_LENGTH 标记，且个数相同，两者就一一对应
+        if(markers != longCount)
+            return false;
+        for(size_t k = 0; k < longCount; k++)
+        {
+            const TokenCacheLongLength& entry = longLengths[k];
+            if(entry.index >= count || (k > 0 && entry.index <= longLengths[k - 1].index)
+               || lengths[entry.index] != TokenBuffer::LONG_LENGTH || sourceSize - offsets[entry.index] < entry.length)
+                return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if(mapped != nullptr)
+            munmap(mapped, mappedSize);
+        mapped = nullptr;
+        symbols = nullptr;
+        mappedSize = count = longCount = 0;
+    }
+
+public:
+    static constexpr uint32_t MAGIC = 0x434B4F54; // "TOKC"
+    static constexpr uint32_t VERSION = 1;
+
+    TokenCache()
+        : mapped(nullptr)
+        , mappedSize(0)
+        , kinds(nullptr)
+        , offsets(nullptr)
+        , lengths(nullptr)
+        , longLengths(nullptr)
+        , symbols(nullptr)
+        , count(0)
+        , longCount(0)
+    {}
+
+    TokenCache(const TokenCache&) = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    ~TokenCache()
+    {
+        close();
+    }
+
+    // Function to map the cache at path, false if it is missing, damaged or made from another source
+    bool open(const char* path, std::string_view source)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(TokenCacheHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        size_t size = size_t(st.st_size);
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void* addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if(addr == MAP_FAILED)
+            return false;
+        mapped = addr;
+        mappedSize = size;
+
+        TokenCacheHeader header;
+        std::memcpy(&header, addr, sizeof(header));
+        // 先比大小，长度相同时才值得算一遍哈希
+        if(header.magic != MAGIC || header.version != VERSION || header.sourceSize != source.size()
+           || header.tokenCount == 0 || header.tokenCount > UINT32_MAX)
+        {
+            close();
+            return false;
+        }
+        size_t n = size_t(header.tokenCount);
+        size_t kindsAt = sizeof(TokenCacheHeader);
+        size_t offsetsAt = alignUp(kindsAt + n, 4);
+        size_t lengthsAt = offsetsAt + n * sizeof(uint32_t);
+        size_t longAt = alignUp(lengthsAt + n * sizeof(uint16_t), 8);
+        if(header.longCount > n || longAt + header.longCount * sizeof(TokenCacheLongLength) != size
+           || header.sourceHash != hashSource(source))
+        {
+            close();
+            return false;
+        }
+        const char* base = static_cast<const char*>(addr);
+        kinds = reinterpret_cast<const TokenKind*>(base + kindsAt);
+        offsets = reinterpret_cast<const uint32_t*>(base + offsetsAt);
+        lengths = reinterpret_cast<const uint16_t*>(base + lengthsAt);
+        longLengths = reinterpret_cast<const TokenCacheLongLength*>(base + longAt);
+        count = n;
+        longCount = size_t(header.longCount);
+        // 序列必须以 END_OF_FILE 结尾，cursor 依赖这一点
+        if(kinds[n - 1] != TokenKind::END_OF_FILE || !tokensInBounds(source.size()))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    size_t size() const { return count; }
+    TokenKind kind(size_t i) const { return kinds[i]; }
+    uint32_t offset(size_t i) const { return offsets[i]; }
+
+    // Function to read symbol IDs from ids, one per cached token, which must outlive the reads
+    // 符号 ID 取决于驻留表，不写进缓存文件；命中以后另外驻留一遍，cursor 就能像读 TokenBuffer 一样读到 ID
+    void useSymbols(const std::vector<uint32_t>& ids) { symbols = &ids; }
+    bool hasSymbols() const { return symbols != nullptr; }
+    uint32_t symbol(size_t i) const { return (*symbols)[i]; }
+
+    uint32_t length(size_t i) const
+    {
+        uint16_t len = lengths[i];
+        if(len != TokenBuffer::LONG_LENGTH)
+            return len;
+        const TokenCacheLongLength* end = longLengths + longCount;
+        const TokenCacheLongLength* it = std::lower_bound(longLengths, end, uint32_t(i),
+            [](const TokenCacheLongLength& entry, uint32_t index) { return entry.index < index; });
+        return it != end && it->index == i ? it->length : len;
+    }
+
+    // Function to write tokens lexed from source to path
+    // 先写到旁边的临时文件再改名，别的进程不会读到写了一半的缓存
+    static bool write(const char* path, const TokenBuffer& tokens, std::string_view source)
+    {
+        size_t n = tokens.size();
+        std::vector<std::pair<uint32_t, uint32_t>> longs = tokens.sortedLongLengths();
+        std::vector<TokenCacheLongLength> longTable;
+        longTable.reserve(longs.size());
+        for(const auto& entry : longs)
+            longTable.push_back(TokenCacheLongLength{entry.first, entry.second});
+        TokenCacheHeader header{MAGIC, VERSION, source.size(), hashSource(source), n, longTable.size()};
+
+        static const char zeros[8] = {};
+        size_t kindsEnd = sizeof(header) + n;
+        size_t lengthsEnd = alignUp(kindsEnd, 4) + n * (sizeof(uint32_t) + sizeof(uint16_t));
+        iovec parts[7] = {
+            {&header, sizeof(header)},
+            {const_cast<TokenKind*>(tokens.kindData()), n * sizeof(TokenKind)},
+            {const_cast<char*>(zeros), alignUp(kindsEnd, 4) - kindsEnd},
+            {const_cast<uint32_t*>(tokens.offsetData()), n * sizeof(uint32_t)},
+            {const_cast<uint16_t*>(tokens.lengthData()), n * sizeof(uint16_t)},
+            {const_cast<char*>(zeros), alignUp(lengthsEnd, 8) - lengthsEnd},
+            {longTable.data(), longTable.size() * sizeof(TokenCacheLongLength)},
+        };
+
+        std::string temp = std::string(path) + ".tmp";
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+            return false;
+        iovec* iov = parts;
+        int left = 7;
+        bool ok = true;
+        while(left > 0)
+        {
+            ssize_t written = ::writev(fd, iov, left);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                ok = false;
+                break;
+            }
+            size_t rest = size_t(written);
+            while(left > 0 && rest >= iov->iov_len)
+            {
+                rest -= iov->iov_len;
+                iov++;
+                left--;
+            }
+            if(left > 0)
+            {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + rest;
+                iov->iov_len -= rest;
+            }
+        }
+        ok = ::close(fd) == 0 && ok;
+        if(!ok || std::rename(temp.c_str(), path) != 0)
+        {
+            std::remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
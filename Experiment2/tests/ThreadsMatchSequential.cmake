@@ -0,0 +1,50 @@
+# 回归测试：错误恢复会原地打转的输入（语句位置上的 “;”），--threads 和顺序分析的输出必须相同，且都能结束
+# usage: cmake -DANALYZER=SyntaxAnalyzer -DWORK_DIR=dir -P ThreadsMatchSequential.cmake
+
+if(NOT ANALYZER OR NOT WORK_DIR)
+    message(FATAL_ERROR "ANALYZER and WORK_DIR must be given")
+endif()
+
+# 三千个函数，足够切成多段并行分析；每种语句轮流出现，“;” 的几种位置都在里面。
+# CMake 的列表用 “;” 分隔元素，所以先写成 “@”，拼好以后再换回来
+set(bodies
+    "@ "
+    "return 1@ "
+    "@ @ x = 1@ "
+    "if (a) @ "
+    "while (a) @ else @ "
+    "x = @ @ "
+    "x = 1@ return x@ ")
+list(LENGTH bodies bodyCount)
+set(source "")
+foreach(i RANGE 2999)
+    math(EXPR k "${i} % ${bodyCount}")
+    list(GET bodies ${k} body)
+    string(APPEND source "int f${i}(int a){ int x@ ${body}return a@ }\n")
+endforeach()
+string(REPLACE "@" ";" source "${source}")
+set(input "${WORK_DIR}/threads_match_sequential.c")
+file(WRITE "${input}" "${source}")
+
+# Function to run the analyzer with extra arguments and store stdout + stderr in outVar
+function(analyze outVar)
+    execute_process(COMMAND "${ANALYZER}" ${ARGN} "${input}"
+                    OUTPUT_VARIABLE out ERROR_VARIABLE err RESULT_VARIABLE result TIMEOUT 60)
+    if(NOT result EQUAL 0)
+        string(REPLACE ";" " " args "${ARGN}")
+        message(FATAL_ERROR "${ANALYZER} ${args} failed: ${result}\n${err}")
+    endif()
+    set(${outVar} "${out}${err}" PARENT_SCOPE)
+endfunction()
+
+foreach(options "" "--max-errors;5" "--messages")
+    analyze(sequential ${options})
+    analyze(parallel --threads 4 ${options})
+    if(NOT sequential MATCHES "^reject\n")
+        message(FATAL_ERROR "expected reject with '${options}', got:\n${sequential}")
+    endif()
+    if(NOT sequential STREQUAL parallel)
+        message(FATAL_ERROR "--threads 4 differs from sequential with '${options}'\n"
+                            "sequential:\n${sequential}\nparallel:\n${parallel}")
+    endif()
+endforeach()